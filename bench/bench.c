@@ -0,0 +1,463 @@
+// # bench
+//
+// Times the search on fixed instances of standard families of exact cover
+// problems, every one counted several times in a process of its own:
+//
+// 	queens       the n queens of examples/nqueens.c, for n from 8 to 13
+// 	sudoku       a set of hard sudokus, selecting the givens of each in turn
+// 	pentominoes  the 12 pentominoes packed into a 6x10 rectangle
+// 	langford     Langford pairs for n = 11 and n = 12
+//
+// Every instance is reported as a JSON object on its own line, with the
+// number of solutions, the nodes and updates of one count, the median and
+// minimum wall time of the counts, the nodes and updates per second at the
+// median and the peak resident set size of its process in kilobytes. Nodes
+// and updates are 0 for a library built with DLX_NO_STATS.
+//
+// 	usage: bench [-C] [-r runs] [family...]
+//
+// 	-C  search with the dancing cells backend
+// 	-r  count every instance this many times, 5 by default
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlx.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct instance {
+    const char *family;
+    unsigned int n;
+    dlx_universe (*build)(unsigned int n);
+    uint64_t (*solve)(dlx_universe u, unsigned int n);
+};
+
+static uint64_t count(dlx_universe u, unsigned int n) {
+    (void)n; // unused
+
+    return dlx_universe_count(u);
+}
+
+// ## Queens
+//
+// Files and ranks are primary columns, the diagonals with more than one
+// square secondary ones, numbered as in examples/nqueens.c.
+
+static dlx_universe queens(unsigned int n) {
+    dlx_universe u = dlx_universe_new(NULL, 2 * n, 4 * n - 6, n * n);
+
+    for (unsigned int i = 0; u != NULL && i < n; ++i) {
+	for (unsigned int j = 0; j < n; ++j) {
+	    uint32_t columns[4] = {j, i + n};
+	    size_t size = 2;
+	    unsigned int diagonal = i + j, reverse = n - 1 + i - j;
+
+	    if (diagonal > 0 && diagonal < 2 * n - 2) {
+		columns[size++] = 2 * n + diagonal - 1;
+	    }
+
+	    if (reverse > 0 && reverse < 2 * n - 2) {
+		columns[size++] = 4 * n - 3 + reverse - 1;
+	    }
+
+	    if (dlx_universe_add_subset_array(u, size, NULL, columns, NULL)) {
+		dlx_universe_free(u);
+		return NULL;
+	    }
+	}
+    }
+
+    return u;
+}
+
+// ## Sudoku
+//
+// Cells, rows, columns and boxes each need every digit once, the subset for
+// digit d in row r and column c is number 81r + 9c + d - 1. The matrix is
+// built once and the givens of every puzzle are selected before counting
+// its solutions and rolled back after.
+
+static const char *const sudokus[] = {
+    "4.....8.5.3..........7....."
+    ".2.....6.....8.4......1...."
+    "...6.3.7.5..2.....1.4......",
+    "52...6.........7.13........"
+    "...4..8..6......5.........."
+    ".418.........3..2...87.....",
+    "6.....8.3.4.7.............."
+    "...5.4.7.3..2.....1.6......"
+    ".2.....5.....8.6......1....",
+    "48.3............71.2......."
+    "7.5....6....2..8..........."
+    "..1.76...3.....4......5....",
+    "....14....3....2...7......."
+    "...9...3.6.1.............8."
+    "2.....1.4....5.6.....7.8...",
+    "8..........36......7..9.2.."
+    ".5...7.......457.....1...3."
+    "..1....68..85...1..9....4..",
+};
+
+#define NUMBER_OF_SUDOKUS (sizeof(sudokus) / sizeof(sudokus[0]))
+
+static dlx_universe sudoku(unsigned int n) {
+    (void)n; // unused
+
+    dlx_universe u = dlx_universe_new(NULL, 4 * 81, 0, 729);
+
+    for (uint32_t r = 0; u != NULL && r < 9; ++r) {
+	for (uint32_t c = 0; c < 9; ++c) {
+	    for (uint32_t d = 0; d < 9; ++d) {
+		uint32_t columns[4] = {
+		    9 * r + c, 81 + 9 * r + d, 162 + 9 * c + d,
+		    243 + 9 * (r / 3 * 3 + c / 3) + d};
+
+		if (dlx_universe_add_subset_array(u, 4, NULL, columns, NULL)) {
+		    dlx_universe_free(u);
+		    return NULL;
+		}
+	    }
+	}
+    }
+
+    return u;
+}
+
+static uint64_t sudoku_solve(dlx_universe u, unsigned int n) {
+    uint64_t solutions = 0;
+
+    (void)n; // unused
+
+    for (size_t i = 0; i < NUMBER_OF_SUDOKUS; ++i) {
+	size_t mark = dlx_universe_mark(u);
+
+	for (size_t cell = 0; cell < 81; ++cell) {
+	    if (sudokus[i][cell] != '.') {
+		dlx_universe_select(
+		    u, 9 * cell + (size_t)(sudokus[i][cell] - '1'));
+	    }
+	}
+
+	solutions += dlx_universe_count(u);
+	dlx_universe_rollback(u, mark);
+    }
+
+    return solutions;
+}
+
+// ## Pentominoes
+//
+// Every pentomino is a primary column to be placed once and so is every
+// cell of the rectangle, a subset per distinct rotation and reflection of a
+// piece at every position it fits. The center of the X, which is symmetric,
+// is kept to the upper left quarter so that every packing is found once
+// instead of along with its rotation and reflections.
+
+#define BOARD_HEIGHT 6
+#define BOARD_WIDTH 10
+
+static const char *const pentominoes[] = {
+    ".##/##./.#.",  // F
+    "#####",        // I
+    "####/#...",    // L
+    "##../.###",    // N
+    "##/##/#.",     // P
+    "###/.#./.#.",  // T
+    "#.#/###",      // U
+    "#../#../###",  // V
+    "#../##./.##",  // W
+    ".#./###/.#.",  // X
+    "####/.#..",    // Y
+    "##./.#./.##",  // Z
+};
+
+#define PENTOMINO_X 9
+
+#define NUMBER_OF_PENTOMINOES (sizeof(pentominoes) / sizeof(pentominoes[0]))
+
+/* Cells of `shape` under transformation `t`, moved to the origin, sorted */
+static void pentomino_cells(const char *shape, unsigned int t, int cells[5]) {
+    int rows[5], columns[5], min_row = 5, min_column = 5, size = 0;
+
+    for (int r = 0, c = 0; *shape; ++shape) {
+	if (*shape == '/') {
+	    ++r;
+	    c = 0;
+	    continue;
+	}
+
+	if (*shape == '#') {
+	    rows[size] = t & 4 ? c : r;
+	    columns[size] = t & 4 ? r : c;
+	    rows[size] *= t & 1 ? -1 : 1;
+	    columns[size] *= t & 2 ? -1 : 1;
+
+	    min_row = rows[size] < min_row ? rows[size] : min_row;
+	    min_column =
+		columns[size] < min_column ? columns[size] : min_column;
+	    ++size;
+	}
+
+	++c;
+    }
+
+    for (int i = 0; i < 5; ++i) {
+	int cell = (rows[i] - min_row) * BOARD_WIDTH + columns[i] - min_column;
+	int j = i;
+
+	for (; j > 0 && cells[j - 1] > cell; --j) {
+	    cells[j] = cells[j - 1];
+	}
+
+	cells[j] = cell;
+    }
+}
+
+static dlx_universe pentomino(unsigned int n) {
+    (void)n; // unused
+
+    dlx_universe u = dlx_universe_new(
+	NULL, NUMBER_OF_PENTOMINOES + BOARD_HEIGHT * BOARD_WIDTH, 0, 2056);
+
+    for (uint32_t p = 0; u != NULL && p < NUMBER_OF_PENTOMINOES; ++p) {
+	int orientations[8][5];
+	unsigned int number_of_orientations = 0;
+
+	for (unsigned int t = 0; t < 8; ++t) {
+	    int *cells = orientations[number_of_orientations];
+	    unsigned int i = 0;
+
+	    pentomino_cells(pentominoes[p], t, cells);
+
+	    while (i < number_of_orientations &&
+		   memcmp(orientations[i], cells, sizeof(int) * 5) != 0) {
+		++i;
+	    }
+
+	    if (i < number_of_orientations) {
+		continue;
+	    }
+
+	    ++number_of_orientations;
+
+	    for (int offset = 0; offset < BOARD_WIDTH * BOARD_HEIGHT;
+		 ++offset) {
+		uint32_t columns[6] = {p};
+		size_t size = 1;
+
+		if (p == PENTOMINO_X &&
+		    (2 * (offset / BOARD_WIDTH + 1) >= BOARD_HEIGHT ||
+		     2 * (offset % BOARD_WIDTH + 1) >= BOARD_WIDTH)) {
+		    continue;
+		}
+
+		for (int k = 0; k < 5; ++k) {
+		    int r = offset / BOARD_WIDTH + cells[k] / BOARD_WIDTH;
+		    int c = offset % BOARD_WIDTH + cells[k] % BOARD_WIDTH;
+
+		    if (r < BOARD_HEIGHT && c < BOARD_WIDTH) {
+			columns[size++] = (uint32_t)(r * BOARD_WIDTH + c) +
+					  NUMBER_OF_PENTOMINOES;
+		    }
+		}
+
+		if (size == 6 && dlx_universe_add_subset_array(
+				     u, size, NULL, columns, NULL)) {
+		    dlx_universe_free(u);
+		    return NULL;
+		}
+	    }
+	}
+    }
+
+    return u;
+}
+
+// ## Langford pairs
+//
+// The two copies of every number k from 1 to n are k positions apart in a
+// sequence of 2n: every number and every position is a primary column, a
+// subset per number and position of its first copy. Every sequence is found
+// along with its reversal.
+
+static dlx_universe langford(unsigned int n) {
+    dlx_universe u = dlx_universe_new(NULL, 3 * n, 0, n * 2 * n);
+
+    for (uint32_t k = 1; u != NULL && k <= n; ++k) {
+	for (uint32_t i = 0; i + k + 1 < 2 * n; ++i) {
+	    uint32_t columns[3] = {k - 1, n + i, n + i + k + 1};
+
+	    if (dlx_universe_add_subset_array(u, 3, NULL, columns, NULL)) {
+		dlx_universe_free(u);
+		return NULL;
+	    }
+	}
+    }
+
+    return u;
+}
+
+static const struct instance instances[] = {
+    {"queens", 8, queens, count},
+    {"queens", 9, queens, count},
+    {"queens", 10, queens, count},
+    {"queens", 11, queens, count},
+    {"queens", 12, queens, count},
+    {"queens", 13, queens, count},
+    {"sudoku", NUMBER_OF_SUDOKUS, sudoku, sudoku_solve},
+    {"pentominoes", 12, pentomino, count},
+    {"langford", 11, langford, count},
+    {"langford", 12, langford, count},
+};
+
+#define NUMBER_OF_INSTANCES (sizeof(instances) / sizeof(instances[0]))
+
+// ## Harness
+
+static double now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static int compare_seconds(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Count `b` `runs` times and print its results */
+static int bench(const struct instance *b, int cells, unsigned int runs) {
+    dlx_universe u = b->build(b->n);
+    struct dlx_stats stats;
+    double *seconds = malloc(sizeof(double) * runs);
+    uint64_t solutions = 0;
+
+    if (u == NULL || seconds == NULL) {
+	fprintf(stderr, "bench: %s %u: out of memory\n", b->family, b->n);
+	return 1;
+    }
+
+    if (cells) {
+	dlx_universe_set_backend(u, DLX_BACKEND_CELLS);
+    }
+
+    dlx_universe_set_stats(u, &stats);
+
+    for (unsigned int i = 0; i < runs; ++i) {
+	memset(&stats, 0, sizeof(stats));
+
+	double start = now();
+	solutions = b->solve(u, b->n);
+	seconds[i] = now() - start;
+    }
+
+    qsort(seconds, runs, sizeof(double), compare_seconds);
+
+    double median = runs % 2 ? seconds[runs / 2]
+			     : (seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf(
+	"{\"family\": \"%s\", \"n\": %u, \"backend\": \"%s\", \"runs\": %u, "
+	"\"solutions\": %llu, \"nodes\": %llu, \"updates\": %llu, "
+	"\"seconds\": %.6f, \"min_seconds\": %.6f, \"nodes_per_second\": %.0f, "
+	"\"updates_per_second\": %.0f, \"max_rss_kb\": %ld}\n",
+	b->family, b->n, cells ? "cells" : "links", runs,
+	(unsigned long long)solutions, (unsigned long long)stats.nodes,
+	(unsigned long long)stats.updates, median, seconds[0],
+	median > 0 ? (double)stats.nodes / median : 0,
+	median > 0 ? (double)stats.updates / median : 0, usage.ru_maxrss);
+
+    free(seconds);
+    dlx_universe_free(u);
+
+    return 0;
+}
+
+static void usage(void) {
+    fputs("usage: bench [-C] [-r runs] [family...]\n", stderr);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int cells = 0, option, failed = 0;
+    unsigned int runs = 5;
+
+    while ((option = getopt(argc, argv, "Cr:")) != -1) {
+	switch (option) {
+	case 'C':
+	    cells = 1;
+	    break;
+	case 'r':
+	    runs = (unsigned int)strtoul(optarg, NULL, 10);
+	    break;
+	default:
+	    usage();
+	}
+    }
+
+    if (runs == 0) {
+	usage();
+    }
+
+    for (int i = optind; i < argc; ++i) {
+	size_t j = 0;
+
+	while (j < NUMBER_OF_INSTANCES &&
+	       strcmp(instances[j].family, argv[i]) != 0) {
+	    ++j;
+	}
+
+	if (j == NUMBER_OF_INSTANCES) {
+	    fprintf(stderr, "bench: unknown family %s\n", argv[i]);
+	    usage();
+	}
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_INSTANCES; ++i) {
+	const struct instance *b = instances + i;
+	int wanted = optind == argc;
+
+	for (int j = optind; j < argc; ++j) {
+	    wanted |= strcmp(b->family, argv[j]) == 0;
+	}
+
+	if (!wanted) {
+	    continue;
+	}
+
+	// A process per instance keeps its peak memory use its own
+	fflush(stdout);
+	pid_t pid = fork();
+
+	if (pid < 0) {
+	    perror("bench");
+	    return 1;
+	}
+
+	if (pid == 0) {
+	    int status = bench(b, cells, runs);
+	    fflush(stdout);
+	    _exit(status);
+	}
+
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+	    failed = 1;
+	}
+    }
+
+    return failed;
+}
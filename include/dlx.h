@@ -1,14 +1,77 @@
 #ifndef __DLX_H__
 #define __DLX_H__
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #define DLX_ALL 0
 
+/* Search status */
+#define DLX_SEARCH_FINISHED 0
+#define DLX_SEARCH_SUSPENDED 1
+#define DLX_SEARCH_ABORTED 2
+
+/* Search backends */
+#define DLX_BACKEND_LINKS 0
+#define DLX_BACKEND_CELLS 1
+
+/* Column choice */
+#define DLX_CHOOSE_FIRST 0
+#define DLX_CHOOSE_RANDOM 1
+
+/* Reductions */
+#define DLX_REDUCE_FORCED 1
+#define DLX_REDUCE_DUPLICATES 2
+#define DLX_REDUCE_DOMINATED 4
+#define DLX_REDUCE_BLOCKING 8
+#define DLX_REDUCE_ALL 15
+
+/* Symmetry reports */
+#define DLX_SYMMETRY_ORBITS 0
+#define DLX_SYMMETRY_CANONICAL 1
+
 /* Objects */
 
 typedef struct dlx_universe *dlx_universe;
 typedef struct dlx_solution_iterator *dlx_solution_iterator;
+typedef struct dlx_reader *dlx_reader;
+typedef struct dlx_sink *dlx_sink;
+typedef struct dlx_zdd *dlx_zdd;
+
+/*
+ * Search statistics, accumulated over every search while set on a universe.
+ * `updates` counts the nodes unlinked and relinked by cover and uncover, and
+ * `profile`, if not NULL, is a caller provided array counting the nodes
+ * visited at each of its first `profile_size` levels.
+ */
+struct dlx_stats {
+    uint64_t nodes;
+    uint64_t updates;
+    uint64_t solutions;
+    size_t max_depth;
+    uint64_t *profile;
+    size_t profile_size;
+};
+
+/*
+ * Estimates of the size of a search made by `dlx_universe_estimate`, each
+ * with the standard error of the mean it is: with the heavy tails of these
+ * estimates the true value is more often below the mean than above, and
+ * errors close to the mean itself call for more probes. `profile`, if not
+ * NULL, is a caller provided array receiving the estimated nodes at each of
+ * the first `profile_size` levels, e.g. to pick a split depth.
+ */
+struct dlx_estimate {
+    double nodes;
+    double solutions;
+    double updates;
+    double nodes_error;
+    double solutions_error;
+    double updates_error;
+    double *profile;
+    size_t profile_size;
+};
 
 /* Functions */
 dlx_universe dlx_universe_new(
@@ -18,16 +81,475 @@ dlx_universe dlx_universe_new(
 
 void dlx_universe_free(dlx_universe universe);
 
-void dlx_universe_add_subset(
+/*
+ * Add a subset of `subset_size` columns, given as unsigned int arguments
+ * after its label. Returns -1 without adding it if a column is out of range,
+ * the subset is empty or memory ran out.
+ */
+int dlx_universe_add_subset(
     dlx_universe universe, size_t subset_size, void *subset_label, ...);
 
-void dlx_universe_search(
+/*
+ * Like `dlx_universe_add_subset` but every column is followed by a color, 0
+ * for none. Subsets sharing a colored secondary column must agree on its
+ * color, instead of excluding each other, colors of primary columns are
+ * ignored. Returns -1 as well if a color is above INT32_MAX.
+ */
+int dlx_universe_add_colored_subset(
+    dlx_universe universe, size_t subset_size, void *subset_label, ...);
+
+/*
+ * Like `dlx_universe_add_subset` with the columns in an array, each with the
+ * color at the same position in `colors`, or none if it is NULL. Returns -1
+ * if a column is out of range, a color above INT32_MAX, the subset is empty
+ * or memory ran out.
+ */
+int dlx_universe_add_subset_array(
+    dlx_universe universe, size_t subset_size, void *subset_label,
+    const uint32_t *columns, const uint32_t *colors);
+
+/*
+ * Add `number_of_subsets` subsets at once in compressed sparse row form:
+ * subset i has the columns (and colors, if not NULL) from position
+ * `offsets[i]` to `offsets[i + 1]` excluded, and label `subset_labels[i]`,
+ * or NULL if `subset_labels` is. The arena grows once for all of them.
+ * Returns -1 without adding any subset if a column is out of range, a color
+ * above INT32_MAX, a subset is empty or memory ran out.
+ */
+int dlx_universe_add_subsets(
+    dlx_universe universe, size_t number_of_subsets, const size_t *offsets,
+    const uint32_t *columns, const uint32_t *colors,
+    void *const *subset_labels);
+
+/*
+ * Require primary column `column` to be covered by at least `lo` and at most
+ * `hi` subsets instead of exactly one, searching with Knuth's Algorithm M.
+ * Returns -1 if the bounds are invalid (`hi` must be positive and at least
+ * `lo`), a search is in progress, the universe is reduced, has subsets
+ * selected or symmetries, or memory ran out.
+ */
+int dlx_universe_set_bounds(
+    dlx_universe universe, size_t column, unsigned int lo, unsigned int hi);
+
+/*
+ * Write the universe to a binary file, for this kind of machine only, with
+ * the labels as 64 bit integers: they must be IDs cast to pointers rather
+ * than addresses to mean anything to the process loading it. Returns -1 if
+ * a search is in progress or writing failed.
+ */
+int dlx_universe_save(dlx_universe universe, const char *path);
+
+/*
+ * Universe saved with `dlx_universe_save`, with the subsets mapped from the
+ * file rather than rebuilt: only the pages a search writes to are copied.
+ * Search settings are not saved. Returns NULL if the file can't be read
+ * or is no valid snapshot, the contents are otherwise trusted.
+ */
+dlx_universe dlx_universe_load(
+    const char *path, void (*solution_handler)(dlx_solution_iterator iter));
+
+/*
+ * Choose how searches represent the matrix, best right after creating the
+ * universe: DLX_BACKEND_LINKS, the default, uses Knuth's dancing links and
+ * DLX_BACKEND_CELLS his dancing cells, compact sparse sets copied from the
+ * links when a search begins, which find the same solutions in a different
+ * order. Universes with bounds or symmetries always use the links, as do
+ * parallel searches and batches, whose many short searches would copy the
+ * cells again every time.
+ */
+void dlx_universe_set_backend(dlx_universe universe, int backend);
+
+/*
+ * Choose which of the columns with the fewest rows searches branch on:
+ * DLX_CHOOSE_FIRST, the default, takes the first one and DLX_CHOOSE_RANDOM
+ * a random one, drawn from `seed`. Universes with bounds always use
+ * Algorithm M's choice.
+ */
+void dlx_universe_set_choice(dlx_universe universe, int choice, uint64_t seed);
+
+/*
+ * Let `chooser` pick the column to branch on instead, e.g. by learned
+ * weights: it is called on every search node with the `count` active primary
+ * columns and how many rows each has left, and returns the position of its
+ * choice among them. It must be thread safe for parallel searches and NULL
+ * restores the choice above. Returns -1 if memory ran out.
+ */
+int dlx_universe_set_chooser(
+    dlx_universe universe,
+    size_t (*chooser)(
+	const size_t *columns, const size_t *sizes, size_t count, void *data),
+    void *data);
+
+/*
+ * Reorder the rows of every column, which searches try in order, by
+ * increasing `priority` of their subset's label or at random. Returns -1
+ * while a search is in progress, subsets are selected or the universe is
+ * reduced, or if memory ran out.
+ */
+int dlx_universe_order_rows(
+    dlx_universe universe, double (*priority)(void *label, void *data),
+    void *data);
+
+int dlx_universe_shuffle_rows(dlx_universe universe, uint64_t seed);
+
+/*
+ * Shrink the matrix before searching with the `reductions` asked for, until
+ * none applies: DLX_REDUCE_FORCED chooses the only row of a primary column
+ * for good, DLX_REDUCE_DUPLICATES removes rows identical to an earlier one,
+ * so solutions only differing by them are found once, DLX_REDUCE_DOMINATED
+ * the rows of a primary column lacking another one whose rows are all in it
+ * and DLX_REDUCE_BLOCKING the rows leaving a primary column empty once
+ * chosen. Solutions list the forced subsets and subsets keep their index.
+ * Subsets must not be added nor bounds set until `dlx_universe_unreduce`
+ * restores the matrix. Returns -1 with a search in progress, bounds or
+ * symmetries set or if memory ran out, keeping the reductions made so far.
+ */
+int dlx_universe_reduce(dlx_universe universe, int reductions);
+
+/* Undo every reduction, and every selection, restoring the matrix as built */
+void dlx_universe_unreduce(dlx_universe universe);
+
+/*
+ * Choose subset `subset` for every search until rolled back, e.g. the given
+ * cells of a puzzle, covering its columns like the search would: solutions
+ * list it and searches start from what it leaves. Returns -1 if a search is
+ * in progress, bounds or symmetries are set, the subset has no primary
+ * column, conflicts with a subset selected before or was removed by a
+ * reduction, or if memory ran out.
+ */
+int dlx_universe_select(dlx_universe universe, size_t subset);
+
+/*
+ * Mark of the changes made to the matrix by selections and reductions so far,
+ * and roll the ones made since `mark` back, in time proportional to them
+ * rather than to the matrix. Searches on the cells backend copy the matrix
+ * while subsets are selected.
+ */
+size_t dlx_universe_mark(dlx_universe universe);
+
+void dlx_universe_rollback(dlx_universe universe, size_t mark);
+
+/*
+ * Declare a symmetry of the problem, e.g. a rotation of the board: column c
+ * maps to `columns[c]` and subset i to `subsets[i]`, which must be subset i
+ * with its columns mapped and the same colors. Searches then only explore
+ * the branches that may lead to the canonical solution of every orbit, the
+ * one with the smallest subset indices among its images by the group the
+ * symmetries generate, of at most 1024 elements. With DLX_SYMMETRY_ORBITS,
+ * the default, the solution handler and counts still get every solution,
+ * the other ones of an orbit right after its canonical solution, and with
+ * DLX_SYMMETRY_CANONICAL only the canonical ones; the pull interface always
+ * returns the canonical ones alone. Returns -1 if the maps are no such
+ * permutations, swap primary and secondary columns, the group is too large,
+ * a search is in progress, the universe is reduced or has bounds or subsets
+ * selected, or if memory ran out. Adding a subset clears the symmetries.
+ */
+int dlx_universe_add_symmetry(
+    dlx_universe universe, const size_t *columns, const size_t *subsets);
+
+void dlx_universe_clear_symmetries(dlx_universe universe);
+
+void dlx_universe_set_symmetry_report(dlx_universe universe, int report);
+
+int dlx_universe_search(
+    dlx_universe universe, unsigned int desired_number_of_solutions);
+
+/*
+ * Look for one solution with randomized restarts: every run shuffles the
+ * rows and breaks ties between columns at random, drawn from `seed`, and is
+ * restarted once it has visited `unit` times the next term of Luby's
+ * sequence 1, 1, 2, 1, 1, 2, 4, ... nodes. The budget applies to all the
+ * runs together. Returns DLX_SEARCH_FINISHED once a solution was passed to
+ * the solution handler or a run proved there is none, and leaves the rows
+ * shuffled. With subsets selected or reductions the rows keep their order
+ * and only the ties are random.
+ */
+int dlx_universe_search_restarts(
+    dlx_universe universe, uint64_t unit, uint64_t seed);
+
+/*
+ * Limit every search to `max_nodes` nodes and `max_seconds` seconds from its
+ * start (0 for no limit). A search running out of budget is aborted, leaving
+ * the universe as it was before the search, and returns DLX_SEARCH_ABORTED.
+ */
+void dlx_universe_set_budget(
+    dlx_universe universe, uint64_t max_nodes, double max_seconds);
+
+/*
+ * Call `progress` every `interval` nodes with an estimate of the fraction of
+ * the search tree explored so far, returning nonzero aborts the search.
+ * Parallel searches only honour the time budget and make no progress calls.
+ */
+void dlx_universe_set_progress(
+    dlx_universe universe, int (*progress)(double fraction, void *data),
+    void *data, uint64_t interval);
+
+/* Status of the last search, e.g. to tell whether a count was aborted */
+int dlx_universe_search_status(dlx_universe universe);
+
+/* Gather statistics into `stats` during searches, NULL to stop */
+void dlx_universe_set_stats(dlx_universe universe, struct dlx_stats *stats);
+
+/* Number of solutions, without building them for the solution handler */
+uint64_t dlx_universe_count(dlx_universe universe);
+
+/*
+ * Estimate the nodes a search for every solution would visit, the solutions
+ * it would find and the updates it would make, as counted by statistics,
+ * with Knuth's random probes: `probes` walks from the root to a leaf, taking
+ * a random row, drawn from `seed`, of the column the search would choose at
+ * every node. Each costs about as much as a search finding its first
+ * solution without backtracking, and the universe is left as it was. Updates
+ * are only estimated with statistics compiled in. Returns -1 if a search is
+ * in progress, bounds are set or `probes` is 0.
+ */
+int dlx_universe_estimate(
+    dlx_universe universe, uint64_t probes, uint64_t seed,
+    struct dlx_estimate *estimate);
+
+/*
+ * Resumable search: `dlx_universe_search_begin` prepares a new search and
+ * every call to `dlx_universe_search_resume` advances it by at most
+ * `max_nodes` nodes (0 means no limit), returning DLX_SEARCH_SUSPENDED if
+ * it stopped early. Subsets must not be added while a search is suspended,
+ * `dlx_universe_search_abort` restores the universe to its initial state.
+ */
+void dlx_universe_search_begin(
     dlx_universe universe, unsigned int desired_number_of_solutions);
 
+int dlx_universe_search_resume(dlx_universe universe, unsigned long max_nodes);
+
+/* Go on counting the solutions of a search begun or restored, see below */
+uint64_t dlx_universe_count_resume(dlx_universe universe);
+
+/*
+ * Checkpoints: with a path set, searches on the links without bounds,
+ * counts included, write their position every `interval` nodes, replacing
+ * the previous checkpoint only once the new one is whole on disk; NULL or
+ * an interval of 0 stops them. `dlx_universe_checkpoint` writes a suspended
+ * search, or one stopped on a solution by the pull interface, right away.
+ * A checkpoint holds the subsets chosen above the selected ones, the number
+ * of solutions found so far and the statistics, if set, so that
+ * `dlx_universe_restore` on the same universe, built the same way with the
+ * same selections, covers the columns back and leaves the search suspended
+ * where it was, to go on with `dlx_universe_search_resume`,
+ * `dlx_universe_count_resume` or the pull interface. Budgets apply to the
+ * restored search alone. Both return -1 if the file can't be written or
+ * read, the search is not in such a state, on the cells backend or with
+ * bounds, or the checkpoint is of another universe.
+ */
+void dlx_universe_set_checkpoint(
+    dlx_universe universe, const char *path, uint64_t interval);
+
+int dlx_universe_checkpoint(dlx_universe universe, const char *path);
+
+int dlx_universe_restore(dlx_universe universe, const char *path);
+
+/*
+ * Pull interface: after `dlx_universe_search_begin` every call returns the
+ * next solution, valid until the following call, or NULL once the search
+ * is finished. The solution handler is not called and may be NULL.
+ */
+dlx_solution_iterator dlx_universe_next_solution(dlx_universe universe);
+
+/*
+ * Parallel search on `number_of_threads` threads (0 for one per processor).
+ * The search tree is split `split_depth` levels deep and the subproblems are
+ * searched on private copies of the universe, threads stealing them from
+ * each other and splitting theirs again for threads left idle, so 0 is a
+ * fine depth. The solution handler may be called concurrently from several
+ * threads and must be thread safe.
+ * Returns 0 on success and -1 if the search could not be completed.
+ * Universes with bounds or symmetries are searched on the calling thread
+ * alone.
+ */
+int dlx_universe_search_parallel(
+    dlx_universe universe, unsigned int desired_number_of_solutions,
+    unsigned int number_of_threads, unsigned int split_depth);
+
+/*
+ * Count the solutions like `dlx_universe_count`, on threads like
+ * `dlx_universe_search_parallel`, each thread keeping a count of its own.
+ * Whether the count was completed is told by `dlx_universe_search_status`.
+ */
+uint64_t dlx_universe_count_parallel(
+    dlx_universe universe, unsigned int number_of_threads,
+    unsigned int split_depth);
+
+/*
+ * Search `number_of_instances` instances of the matrix on `number_of_threads`
+ * threads (0 for one per processor), each on its own copy of the universe:
+ * instance i selects the subsets from position `offsets[i]` to
+ * `offsets[i + 1]` excluded of `subsets`, like `dlx_universe_select` would,
+ * then looks for `desired_number_of_solutions`. The solution handler may be
+ * called concurrently and tells instances apart with
+ * `dlx_solution_iterator_instance`. If not NULL, `solutions[i]` receives the
+ * number of solutions of instance i and `statuses[i]` the status of its
+ * search, or -1 if its subsets could not be selected. Budgets apply to every
+ * instance on its own. Returns -1 if some instances could not be searched.
+ */
+int dlx_universe_search_batch(
+    dlx_universe universe, size_t number_of_instances, const size_t *offsets,
+    const size_t *subsets, unsigned int desired_number_of_solutions,
+    unsigned int number_of_threads, uint64_t *solutions, int *statuses);
+
+/*
+ * Sharding, to spread a search over processes sharing nothing but files:
+ * `dlx_universe_write_shards` writes every node of the search tree `depth`
+ * levels down, and every solution found sooner, as a line of the indices of
+ * the subsets chosen on its path, starting after any subset selected
+ * beforehand. Dead ends are left out, and together the shards hold every
+ * solution once. Returns -1 if bounds or symmetries are set, a search is in
+ * progress or writing failed.
+ *
+ * A worker building the same universe, with the same selections, then takes
+ * shards one line at a time with `dlx_universe_select_shard`, which selects
+ * their subsets like `dlx_universe_select` so that a search or count covers
+ * the shard's subtree alone, until `dlx_universe_rollback` to a mark taken
+ * before. Returns 1 once a shard is selected, 0 at the end of the file and
+ * -1, selecting nothing and skipping the line, if it holds anything but
+ * indices separated by spaces or one can't be selected.
+ */
+int dlx_universe_write_shards(
+    dlx_universe universe, unsigned int depth, FILE *file);
+
+int dlx_universe_select_shard(dlx_universe universe, FILE *file);
+
+void dlx_universe_search_abort(dlx_universe universe);
+
+/*
+ * Solution sinks take the solutions of a search instead of the solution
+ * handler and write the indices of their subsets compactly, each solution
+ * only giving the ones that differ from the previous solution. A sink on a
+ * file descriptor writes out its buffer whenever it fills up and at the end
+ * of the search, with `fd` negative it keeps all the solutions in memory.
+ */
+dlx_sink dlx_sink_new(int fd);
+
+/*
+ * Search, writing the solutions to `sink`. Returns the search status, or -1
+ * if writing failed, which aborts the search.
+ */
+int dlx_universe_search_sink(
+    dlx_universe universe, unsigned int desired_number_of_solutions,
+    dlx_sink sink);
+
+/* Bytes written to the sink since it was last cleared or flushed */
+const uint8_t *dlx_sink_data(dlx_sink sink, size_t *size);
+
+/* Number of solutions written since the sink was last cleared */
+uint64_t dlx_sink_solutions(dlx_sink sink);
+
+/*
+ * Empty the sink and forget any error, e.g. once its data is consumed, the
+ * next solution is then written in full
+ */
+void dlx_sink_clear(dlx_sink sink);
+
+void dlx_sink_free(dlx_sink sink);
+
+/*
+ * Decode the solution at `*data` into `indices`, which must hold the
+ * previous solution decoded from the same data, moving `*data` past it.
+ * Returns the number of subsets of the solution. `indices` must have room
+ * for the longest solution: the number of primary columns, or the sum of
+ * their upper bounds if any are set.
+ */
+size_t dlx_sink_decode(const uint8_t **data, size_t *indices);
+
+/*
+ * Zero-suppressed decision diagram of all the solutions, for problems with
+ * too many to enumerate: searching like Knuth's Algorithm Z, every
+ * subproblem, given by the columns left and the colors of the secondary
+ * ones, is solved once and shared by every path leading to it. Budgets
+ * apply, progress is not reported. Returns NULL if the budget ran out,
+ * bounds are set or memory ran out.
+ */
+dlx_zdd dlx_universe_zdd(dlx_universe universe);
+
+/*
+ * Nodes are numbered from 2 to `dlx_zdd_size` excluded, node 0 being the
+ * sink with no solution and node 1 the one with the empty solution. Every
+ * node returns the index of its subset and points `lo` at the node of the
+ * solutions without it and `hi` at the rest of the solutions with it. Both
+ * come before the node, and the subsets selected before the diagram was
+ * built are in every solution without being in the diagram.
+ */
+size_t dlx_zdd_size(dlx_zdd zdd);
+
+size_t dlx_zdd_root(dlx_zdd zdd);
+
+size_t dlx_zdd_node(dlx_zdd zdd, size_t node, size_t *lo, size_t *hi);
+
+/*
+ * Write the exact number of solutions in decimal to `buffer` like
+ * `snprintf`, returning the number of digits, or 0 if memory ran out
+ */
+size_t dlx_zdd_count(dlx_zdd zdd, char *buffer, size_t size);
+
+/*
+ * Write the indices of a solution drawn uniformly at random to `indices`,
+ * returning their number, or SIZE_MAX if there is no solution or memory ran
+ * out. `*state` is the state of the generator, any value to start with,
+ * and is advanced by every draw. `indices` must have room for the longest
+ * solution, as for `dlx_sink_decode`.
+ */
+size_t dlx_zdd_sample(dlx_zdd zdd, uint64_t *state, size_t *indices);
+
+void dlx_zdd_free(dlx_zdd zdd);
+
+/*
+ * Reader for problems in the text format of Knuth's DLX programs: after
+ * comment lines starting with '|', a line of item names, with a lone '|'
+ * between the primary and the secondary ones, then one option per line.
+ * Secondary items of options may have a color, as in "item:color", and
+ * primary items may be declared with bounds, as in "lo:hi|item" or
+ * "hi|item".
+ */
+dlx_reader dlx_reader_new(FILE *file);
+
+/*
+ * Read the whole file into a new universe whose subsets are the options,
+ * labeled with their index cast to a pointer. Returns NULL on error, which
+ * `dlx_reader_error` then describes.
+ */
+dlx_universe dlx_reader_read(
+    dlx_reader reader, void (*solution_handler)(dlx_solution_iterator iter));
+
+const char *dlx_reader_error(dlx_reader reader);
+
+size_t dlx_reader_items(dlx_reader reader);
+
+const char *dlx_reader_item(dlx_reader reader, size_t item);
+
+/* Name of a color, numbered from 1 in order of appearance */
+const char *dlx_reader_color(dlx_reader reader, uint32_t color);
+
+size_t dlx_reader_options(dlx_reader reader);
+
+/*
+ * Number of items of an option, pointing `items` and `colors` (0 for none)
+ * at them, valid until the reader is freed
+ */
+size_t dlx_reader_option(
+    dlx_reader reader, size_t option, const uint32_t **items,
+    const uint32_t **colors);
+
+void dlx_reader_free(dlx_reader reader);
+
 void dlx_solution_iterator_rewind(struct dlx_solution_iterator *iter);
 
 void *dlx_solution_iterator_next(struct dlx_solution_iterator *iter);
 
 size_t dlx_solution_iterator_remaining(struct dlx_solution_iterator *iter);
 
+/*
+ * Like `dlx_solution_iterator_next` but returns the index of the subset, in
+ * the order they were added, or SIZE_MAX once done
+ */
+size_t dlx_solution_iterator_next_index(struct dlx_solution_iterator *iter);
+
+/* Instance of a batch search the solution belongs to, 0 for other searches */
+size_t dlx_solution_iterator_instance(struct dlx_solution_iterator *iter);
+
 #endif
@@ -1,44 +1,91 @@
-#include "dlx.h"
+#include "dlx_internal.h"
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
 
-#define FOREACH(it, node, direction)                                           \
-    for (struct dlx_node *it = (node)->direction; it != (node);                \
-	 it = it->direction)
+size_t subset_index(const struct dlx_node *nodes, uint32_t node) {
+    while (nodes[node].top > 0) {
+	--node;
+    }
+
+    return (size_t)-nodes[node].top;
+}
 
-struct dlx_node {
-    struct dlx_node *up, *down, *left, *right;
+/*
+ * Unlink or relink the other nodes of `node`'s subset, updating the small
+ * columns if `tracked`. Being inlined with a constant `tracked`, universes
+ * too small for the bitsets don't pay for the checks.
+ */
 
-    union {
-	struct {
-	    struct dlx_node *column;
-	    void *subset_label;
-	};
-	unsigned int size;
-    };
-};
+static inline uint32_t hide_nodes(
+    struct dlx_universe *u, uint32_t node, int tracked) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t updates = 0;
+
+    FOREACH(it, nodes, node, node_right) {
+	if (nodes[it].color < 0) {
+	    continue;
+	}
 
-struct dlx_solution_iterator {
-    struct dlx_node **solutions;
-    size_t index;
-    size_t end;
-};
+	uint32_t up = nodes[it].up, down = nodes[it].down;
+	uint32_t column = (uint32_t)nodes[it].top;
+
+	nodes[up].down = down;
+	nodes[down].up = up;
+	--nodes[column].top;
+	++updates;
+
+	if (tracked && column <= u->small_columns.limit &&
+	    nodes[column].top <= 1) {
+	    small_columns_resize(
+		&u->small_columns, column, nodes[column].top + 1,
+		nodes[column].top);
+	}
+    }
 
-struct dlx_universe {
-    struct dlx_node root;
+    return updates;
+}
+
+static inline uint32_t unhide_nodes(
+    struct dlx_universe *u, uint32_t node, int tracked) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t updates = 0;
+
+    FOREACH(it, nodes, node, node_left) {
+	if (nodes[it].color < 0) {
+	    continue;
+	}
+
+	uint32_t up = nodes[it].up, down = nodes[it].down;
+	uint32_t column = (uint32_t)nodes[it].top;
+
+	nodes[up].down = it;
+	nodes[down].up = it;
+	++nodes[column].top;
+	++updates;
+
+	if (tracked && column <= u->small_columns.limit &&
+	    nodes[column].top <= 2) {
+	    small_columns_resize(
+		&u->small_columns, column, nodes[column].top - 1,
+		nodes[column].top);
+	}
+    }
 
-    struct dlx_node *column_headers;
-    size_t column_headers_size;
+    return updates;
+}
 
-    struct dlx_node **subsets;
-    size_t subsets_size;
+/* Both return the number of nodes they unlink or relink */
 
-    struct dlx_node **solution_stack;
-    size_t solution_stack_size;
+uint32_t hide(struct dlx_universe *u, uint32_t node) {
+    return u->small_columns.limit ? hide_nodes(u, node, 1)
+				  : hide_nodes(u, node, 0);
+}
 
-    void (*solution_handler)(struct dlx_solution_iterator *iter);
-    struct dlx_solution_iterator solution_iterator;
-    unsigned int number_of_solutions_found;
-};
+uint32_t unhide(struct dlx_universe *u, uint32_t node) {
+    return u->small_columns.limit ? unhide_nodes(u, node, 1)
+				  : unhide_nodes(u, node, 0);
+}
 
 // dlx_solution_iterator methods
 
@@ -48,8 +95,12 @@ void dlx_solution_iterator_rewind(struct dlx_solution_iterator *iter) {
 
 void dlx_solution_iterator_init(
     struct dlx_solution_iterator *iter, struct dlx_universe *universe) {
+    iter->nodes = universe->nodes;
+    iter->subset_labels = universe->subset_labels;
+    iter->solutions = universe->solution_stack;
     iter->index = 0;
     iter->end = universe->solution_stack_size;
+    iter->instance = universe->instance;
 }
 
 void *dlx_solution_iterator_next(struct dlx_solution_iterator *iter) {
@@ -57,72 +108,146 @@ void *dlx_solution_iterator_next(struct dlx_solution_iterator *iter) {
 	return NULL;
     }
 
-    return iter->solutions[iter->index++]->subset_label;
+    return iter->subset_labels[subset_index(
+	iter->nodes, iter->solutions[iter->index++])];
+}
+
+size_t dlx_solution_iterator_next_index(struct dlx_solution_iterator *iter) {
+    if (iter->index >= iter->end) {
+	return SIZE_MAX;
+    }
+
+    return subset_index(iter->nodes, iter->solutions[iter->index++]);
 }
 
 size_t dlx_solution_iterator_remaining(struct dlx_solution_iterator *iter) {
     return iter->end - iter->index;
 }
 
-// dlx_node methods
-
-void append_self_horizontally(struct dlx_node *node) {
-    node->right = node;
-    node->left = node;
+size_t dlx_solution_iterator_instance(struct dlx_solution_iterator *iter) {
+    return iter->instance;
 }
 
-void append_self_vertically(struct dlx_node *node) {
-    node->up = node;
-    node->down = node;
-}
+// dlx_universe methods
+
+void cover(struct dlx_universe *u, uint32_t column) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t left = u->columns[column].left, right = u->columns[column].right;
+
+    u->columns[left].right = right;
+    u->columns[right].left = left;
+
+    if (column <= u->small_columns.limit) {
+	small_columns_erase(&u->small_columns, column, nodes[column].top);
+    }
+
+    uint64_t unlinked = 0;
 
-void append_left(struct dlx_node *node, struct dlx_node *left) {
-    node->right = left->right;
-    node->left = left;
-    left->right->left = node;
-    node->left->right = node;
+    FOREACH(row, nodes, column, node_down) { unlinked += hide(u, row); }
+
+    STAT(u, stats->updates += unlinked);
 }
 
-void append_above(struct dlx_node *node, struct dlx_node *up) {
-    node->down = up->down;
-    node->up = up;
-    up->down->up = node;
-    node->up->down = node;
+void uncover(struct dlx_universe *u, uint32_t column) {
+    struct dlx_node *nodes = u->nodes;
+
+    uint64_t relinked = 0;
+
+    FOREACH(row, nodes, column, node_up) { relinked += unhide(u, row); }
+
+    STAT(u, stats->updates += relinked);
+
+    u->columns[u->columns[column].left].right = column;
+    u->columns[u->columns[column].right].left = column;
+
+    if (column <= u->small_columns.limit) {
+	small_columns_insert(&u->small_columns, column, nodes[column].top);
+    }
 }
 
-void cover(struct dlx_node *column) {
-    column->left->right = column->right;
-    column->right->left = column->left;
+void stats_node(struct dlx_stats *stats, size_t level) {
+    ++stats->nodes;
+
+    if (level > stats->max_depth) {
+	stats->max_depth = level;
+    }
 
-    FOREACH(row, column, down) {
-	FOREACH(it, row, right) {
-	    it->up->down = it->down;
-	    it->down->up = it->up;
-	    --it->column->size;
+    if (stats->profile && level < stats->profile_size) {
+	++stats->profile[level];
+    }
+}
+
+void purify(struct dlx_universe *u, uint32_t node) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t column = (uint32_t)nodes[node].top;
+    int32_t color = nodes[node].color;
+    uint64_t unlinked = 0;
+
+    FOREACH(row, nodes, column, node_down) {
+	if (nodes[row].color != color) {
+	    unlinked += hide(u, row);
+	} else if (row != node) {
+	    nodes[row].color = -1;
 	}
     }
+
+    STAT(u, stats->updates += unlinked);
 }
 
-void uncover(struct dlx_node *column) {
-    FOREACH(row, column, up) {
-	FOREACH(it, row, left) {
-	    it->up->down = it;
-	    it->down->up = it;
-	    ++it->column->size;
+void unpurify(struct dlx_universe *u, uint32_t node) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t column = (uint32_t)nodes[node].top;
+    int32_t color = nodes[node].color;
+    uint64_t relinked = 0;
+
+    FOREACH(row, nodes, column, node_up) {
+	if (nodes[row].color < 0) {
+	    nodes[row].color = color;
+	} else if (row != node) {
+	    relinked += unhide(u, row);
 	}
     }
 
-    column->left->right = column;
-    column->right->left = column;
+    STAT(u, stats->updates += relinked);
 }
 
-// dlx_universe methods
+/* Cover or purify the column of a node of a chosen subset */
+void commit(struct dlx_universe *u, uint32_t node) {
+    int32_t color = u->nodes[node].color;
+
+    if (color == 0) {
+	cover(u, (uint32_t)u->nodes[node].top);
+    } else if (color > 0) {
+	purify(u, node);
+    }
+}
 
-struct dlx_node *choose_column(struct dlx_universe *u) {
-    struct dlx_node *it, *column = u->root.right;
+void uncommit(struct dlx_universe *u, uint32_t node) {
+    int32_t color = u->nodes[node].color;
 
-    for (it = column->right; it != &u->root; it = it->right) {
-	if (it->size < column->size) {
+    if (color == 0) {
+	uncover(u, (uint32_t)u->nodes[node].top);
+    } else if (color > 0) {
+	unpurify(u, node);
+    }
+}
+
+/* First column with the fewest rows, unless another strategy is set */
+uint32_t choose_column(struct dlx_universe *u) {
+    if (u->chooser || u->choice) {
+	return choose_column_strategy(u);
+    }
+
+    uint32_t it, column = small_columns_first(&u->small_columns);
+
+    if (column) {
+	return column;
+    }
+
+    column = u->columns[0].right;
+
+    for (it = u->columns[column].right; it != 0; it = u->columns[it].right) {
+	if (u->nodes[it].top < u->nodes[column].top) {
 	    column = it;
 	}
     }
@@ -130,11 +255,84 @@ struct dlx_node *choose_column(struct dlx_universe *u) {
     return column;
 }
 
+int small_columns_init(
+    struct dlx_small_columns *s, size_t columns_size,
+    size_t primary_columns_size) {
+    size_t words = (columns_size + 63) / 64;
+
+    s->bits[0] = calloc(2 * words, sizeof(uint64_t));
+    s->bits[1] = s->bits[0] + words;
+    s->counts[0] = s->counts[1] = 0;
+    s->limit = primary_columns_size < SMALL_COLUMNS_THRESHOLD
+		   ? 0
+		   : (uint32_t)primary_columns_size;
+
+    return s->bits[0] == NULL ? -1 : 0;
+}
+
+int reserve_nodes(struct dlx_universe *u, size_t additional_nodes) {
+    size_t capacity = u->nodes_capacity;
+
+    if (u->nodes_size + additional_nodes <= capacity) {
+	return 0;
+    }
+
+    while (capacity < u->nodes_size + additional_nodes) {
+	capacity *= 2;
+    }
+
+    if (capacity > UINT32_MAX) {
+	return -1;
+    }
+
+    // Mapped nodes are moved to the heap
+    struct dlx_node *nodes =
+	u->mapping ? malloc(sizeof(struct dlx_node) * capacity)
+		   : realloc(u->nodes, sizeof(struct dlx_node) * capacity);
+
+    if (nodes == NULL) {
+	return -1;
+    }
+
+    if (u->mapping) {
+	memcpy(nodes, u->nodes, sizeof(struct dlx_node) * u->nodes_size);
+	snapshot_unmap(u);
+    }
+
+    u->nodes = nodes;
+    u->nodes_capacity = capacity;
+
+    return 0;
+}
+
+int reserve_subsets(struct dlx_universe *u, size_t additional_subsets) {
+    size_t capacity = u->subsets_capacity;
+
+    if (u->subsets_size + additional_subsets <= capacity) {
+	return 0;
+    }
+
+    while (capacity < u->subsets_size + additional_subsets) {
+	capacity *= 2;
+    }
+
+    void **subset_labels = realloc(u->subset_labels, sizeof(void *) * capacity);
+
+    if (subset_labels == NULL) {
+	return -1;
+    }
+
+    u->subset_labels = subset_labels;
+    u->subsets_capacity = capacity;
+
+    return 0;
+}
+
 struct dlx_universe *dlx_universe_new(
     void (*solution_handler)(struct dlx_solution_iterator *iter),
     size_t number_of_primary_constraints,
     size_t number_of_secondary_constraints, size_t number_of_subsets) {
-    struct dlx_universe *universe = malloc(sizeof(struct dlx_universe));
+    struct dlx_universe *universe = calloc(1, sizeof(struct dlx_universe));
 
     if (universe == NULL) {
 	return NULL;
@@ -143,122 +341,766 @@ struct dlx_universe *dlx_universe_new(
     size_t number_of_constraints =
 	number_of_primary_constraints + number_of_secondary_constraints;
 
-    universe->column_headers =
-	malloc(sizeof(struct dlx_node) * number_of_constraints);
-
-    if (universe->column_headers == NULL) {
+    if (number_of_constraints >= INT32_MAX) {
+	dlx_universe_free(universe);
 	return NULL;
     }
 
-    universe->column_headers_size = number_of_constraints;
+    universe->columns_size = number_of_constraints + 1;
+    universe->primary_columns_size = number_of_primary_constraints;
+    universe->columns =
+	malloc(sizeof(struct dlx_column) * universe->columns_size);
+
+    // Column headers and the first spacer, plus a guess of four nodes and a
+    // spacer per subset, the arena grows as needed
+    universe->nodes_capacity =
+	universe->columns_size + 1 + number_of_subsets * 5;
+    universe->nodes =
+	malloc(sizeof(struct dlx_node) * universe->nodes_capacity);
 
-    universe->subsets = malloc(sizeof(struct dlx_node *) * number_of_subsets);
+    universe->subsets_capacity = number_of_subsets ? number_of_subsets : 1;
+    universe->subset_labels =
+	malloc(sizeof(void *) * universe->subsets_capacity);
 
-    if (universe->subsets == NULL) {
+    universe->solution_stack_capacity = universe->columns_size;
+    universe->solution_stack =
+	malloc(sizeof(uint32_t) * universe->solution_stack_capacity);
+
+    if (universe->columns == NULL || universe->nodes == NULL ||
+	universe->subset_labels == NULL || universe->solution_stack == NULL ||
+	small_columns_init(
+	    &universe->small_columns, universe->columns_size,
+	    universe->primary_columns_size)) {
+	dlx_universe_free(universe);
 	return NULL;
     }
 
-    universe->subsets_size = 0;
+    universe->solution_handler = solution_handler;
 
-    universe->solution_stack =
-	malloc(sizeof(struct dlx_node *) * number_of_constraints);
+    struct dlx_column *columns = universe->columns;
+    struct dlx_node *nodes = universe->nodes;
+
+    columns[0].left = columns[0].right = 0;
+    nodes[0].top = nodes[0].color = 0;
+    nodes[0].up = nodes[0].down = 0;
+
+    for (uint32_t i = 1; i < universe->columns_size; ++i) {
+	if (i <= number_of_primary_constraints) {
+	    columns[i].left = columns[0].left;
+	    columns[i].right = 0;
+	    columns[columns[0].left].right = i;
+	    columns[0].left = i;
+	} else {
+	    columns[i].left = columns[i].right = i;
+	}
 
-    if (universe->solution_stack == NULL) {
-	return NULL;
+	if (i <= universe->small_columns.limit) {
+	    small_columns_insert(&universe->small_columns, i, 0);
+	}
+
+	nodes[i].top = nodes[i].color = 0;
+	nodes[i].up = nodes[i].down = i;
     }
 
-    universe->solution_iterator.solutions = universe->solution_stack;
+    // First spacer
+    universe->nodes_size = universe->columns_size + 1;
+    nodes[universe->columns_size].top = 0;
+    nodes[universe->columns_size].color = 0;
+    nodes[universe->columns_size].up = 0;
+    nodes[universe->columns_size].down = 0;
 
-    universe->solution_stack_size = 0;
-    universe->number_of_solutions_found = 0;
-    universe->solution_handler = solution_handler;
+    return universe;
+}
 
-    append_self_vertically(&universe->root);
-    append_self_horizontally(&universe->root);
+/* Copy of the universe in its current state, for use by another thread */
+struct dlx_universe *universe_clone(const struct dlx_universe *u) {
+    struct dlx_universe *clone = malloc(sizeof(struct dlx_universe));
 
-    for (size_t i = 0; i < number_of_primary_constraints; ++i) {
-	append_self_vertically(universe->column_headers + i);
-	append_left(universe->column_headers + i, universe->root.left);
-	universe->column_headers[i].size = 0;
+    if (clone == NULL) {
+	return NULL;
     }
 
-    for (size_t i = number_of_primary_constraints; i < number_of_constraints;
-	 ++i) {
-	append_self_vertically(universe->column_headers + i);
-	append_self_horizontally(universe->column_headers + i);
-	universe->column_headers[i].size = 0;
+    *clone = *u;
+    clone->columns = malloc(sizeof(struct dlx_column) * u->columns_size);
+    clone->nodes = malloc(sizeof(struct dlx_node) * u->nodes_capacity);
+    clone->subset_labels = malloc(sizeof(void *) * u->subsets_capacity);
+    clone->solution_stack =
+	malloc(sizeof(uint32_t) * u->solution_stack_capacity);
+    clone->small_columns.bits[0] = NULL;
+    clone->cells = NULL;
+
+    // Copies search many short tasks or instances, for which the cells would
+    // be copied from the links every time, and parallel searches split their
+    // tasks on the links
+    clone->backend = DLX_BACKEND_LINKS;
+    clone->bounds = NULL;
+    clone->first_tweaks = NULL;
+    clone->solution_subsets = NULL;
+    clone->chooser_columns = NULL;
+    clone->mapping = NULL;
+    clone->reduce_log = NULL;
+    clone->reduce_log_size = clone->reduce_log_capacity = 0;
+    clone->subset_nodes = NULL;
+    clone->subset_nodes_size = clone->subset_nodes_capacity = 0;
+    clone->symmetries = NULL;
+    clone->checkpoint_path = NULL;
+    clone->checkpoint_interval = 0;
+
+    if (u->symmetries) {
+	clone->symmetries =
+	    symmetries_clone(u->symmetries, u->solution_stack_capacity);
     }
 
-    return universe;
+    if (u->bounds) {
+	clone->bounds = malloc(sizeof(struct dlx_bounds) * u->columns_size);
+	clone->first_tweaks =
+	    malloc(sizeof(uint32_t) * u->solution_stack_capacity);
+	clone->solution_subsets =
+	    malloc(sizeof(uint32_t) * u->solution_stack_capacity);
+    }
+
+    if (clone->columns == NULL || clone->nodes == NULL ||
+	clone->subset_labels == NULL || clone->solution_stack == NULL ||
+	small_columns_init(
+	    &clone->small_columns, u->columns_size, u->primary_columns_size) ||
+	(u->bounds && (clone->bounds == NULL || clone->first_tweaks == NULL ||
+		       clone->solution_subsets == NULL)) ||
+	(u->chooser_columns && chooser_reserve(clone)) ||
+	(u->symmetries && clone->symmetries == NULL)) {
+	dlx_universe_free(clone);
+	return NULL;
+    }
+
+    memcpy(
+	clone->columns, u->columns,
+	sizeof(struct dlx_column) * u->columns_size);
+    memcpy(clone->nodes, u->nodes, sizeof(struct dlx_node) * u->nodes_size);
+    memcpy(
+	clone->subset_labels, u->subset_labels,
+	sizeof(void *) * u->subsets_size);
+    memcpy(
+	clone->solution_stack, u->solution_stack,
+	sizeof(uint32_t) * u->solution_stack_size);
+    memcpy(
+	clone->small_columns.bits[0], u->small_columns.bits[0],
+	sizeof(uint64_t) * 2 * ((u->columns_size + 63) / 64));
+    clone->small_columns.counts[0] = u->small_columns.counts[0];
+    clone->small_columns.counts[1] = u->small_columns.counts[1];
+
+    if (u->bounds) {
+	memcpy(
+	    clone->bounds, u->bounds,
+	    sizeof(struct dlx_bounds) * u->columns_size);
+	memcpy(
+	    clone->first_tweaks, u->first_tweaks,
+	    sizeof(uint32_t) * u->solution_stack_size);
+    }
+
+    return clone;
 }
 
 void dlx_universe_free(struct dlx_universe *universe) {
-    for (size_t i = 0; i < universe->subsets_size; ++i) {
-	free(universe->subsets[i]);
+    free(universe->subset_labels);
+    free(universe->solution_stack);
+    free(universe->bounds);
+    free(universe->first_tweaks);
+    free(universe->solution_subsets);
+    free(universe->small_columns.bits[0]);
+    free(universe->chooser_columns);
+    free(universe->reduce_log);
+    free(universe->subset_nodes);
+    symmetries_free(universe->symmetries);
+    free(universe->checkpoint_path);
+    cells_free(universe->cells);
+
+    if (universe->mapping) {
+	snapshot_unmap(universe);
+    } else {
+	free(universe->nodes);
     }
 
-    free(universe->subsets);
-    free(universe->solution_stack);
-    free(universe->column_headers);
+    free(universe->columns);
     free(universe);
 }
 
-void dlx_universe_add_subset(
+/* Link node `i` at the top of `column`, an index in the arena */
+static inline void add_node(
+    struct dlx_universe *universe, uint32_t i, uint32_t column,
+    unsigned int color) {
+    struct dlx_node *nodes = universe->nodes;
+
+    nodes[i].top = (int32_t)column;
+    nodes[i].up = column;
+    nodes[i].down = nodes[column].down;
+    nodes[nodes[column].down].up = i;
+    nodes[column].down = i;
+    ++nodes[column].top;
+
+    if (column <= universe->small_columns.limit) {
+	small_columns_resize(
+	    &universe->small_columns, column, nodes[column].top - 1,
+	    nodes[column].top);
+    }
+
+    // Primary columns must be covered whatever the color
+    nodes[i].color =
+	column > universe->primary_columns_size ? (int32_t)color : 0;
+}
+
+/* Close the subset of the nodes added from `first` with a spacer */
+static inline void close_subset(
+    struct dlx_universe *universe, uint32_t first, size_t subset_size,
+    void *subset_label) {
+    struct dlx_node *nodes = universe->nodes;
+    uint32_t last = first + (uint32_t)subset_size - 1;
+
+    // The spacer points back to the first node of the subset
+    nodes[first - 1].down = last;
+    nodes[last + 1].top = -(int32_t)(universe->subsets_size + 1);
+    nodes[last + 1].up = first;
+    nodes[last + 1].down = 0;
+    nodes[last + 1].color = 0;
+
+    universe->subset_labels[universe->subsets_size++] = subset_label;
+    universe->nodes_size += subset_size + 1;
+
+    // The symmetries only permute the subsets they were added with
+    if (universe->symmetries) {
+	dlx_universe_clear_symmetries(universe);
+    }
+}
+
+/* Colors are only read when `colored`, as a second argument per column */
+int add_subset(
+    struct dlx_universe *universe, size_t subset_size, void *subset_label,
+    va_list args, int colored) {
+    if (subset_size == 0 || reserve_nodes(universe, subset_size + 1) ||
+	reserve_subsets(universe, 1)) {
+	return -1;
+    }
+
+    struct dlx_node *nodes = universe->nodes;
+    uint32_t first = (uint32_t)universe->nodes_size;
+
+    // The nodes reserved hold the columns and colors until all are checked,
+    // so that nothing is added on error
+    for (uint32_t i = first; i < first + subset_size; ++i) {
+	unsigned int column = va_arg(args, unsigned int);
+	unsigned int color = colored ? va_arg(args, unsigned int) : 0;
+
+	if (column >= universe->columns_size - 1 || color > INT32_MAX) {
+	    return -1;
+	}
+
+	nodes[i].top = (int32_t)column + 1;
+	nodes[i].color = (int32_t)color;
+    }
+
+    for (uint32_t i = first; i < first + subset_size; ++i) {
+	add_node(
+	    universe, i, (uint32_t)nodes[i].top, (unsigned int)nodes[i].color);
+    }
+
+    close_subset(universe, first, subset_size, subset_label);
+
+    return 0;
+}
+
+int dlx_universe_add_subset(
     struct dlx_universe *universe, size_t subset_size, void *subset_label,
     ...) {
     va_list args;
-    struct dlx_node *subset = malloc(sizeof(struct dlx_node) * subset_size);
 
     va_start(args, subset_label);
+    int result = add_subset(universe, subset_size, subset_label, args, 0);
+    va_end(args);
 
-    append_self_horizontally(subset);
+    return result;
+}
 
-    for (unsigned int i = 0; i < subset_size; ++i) {
-	subset[i].subset_label = subset_label;
-	subset[i].column =
-	    universe->column_headers + va_arg(args, unsigned int);
-	append_above(subset + i, subset[i].column);
-	append_left(subset + i, subset[0].left);
-	++subset[i].column->size;
-    }
+int dlx_universe_add_colored_subset(
+    struct dlx_universe *universe, size_t subset_size, void *subset_label,
+    ...) {
+    va_list args;
 
+    va_start(args, subset_label);
+    int result = add_subset(universe, subset_size, subset_label, args, 1);
     va_end(args);
 
-    universe->subsets[universe->subsets_size++] = subset;
+    return result;
 }
 
-void dlx_universe_search(
-    struct dlx_universe *universe, unsigned int desired_number_of_solutions) {
-    if (universe->root.right == &universe->root) {
-	dlx_solution_iterator_init(&universe->solution_iterator, universe);
-	(*universe->solution_handler)(&universe->solution_iterator);
-	++universe->number_of_solutions_found;
+int dlx_universe_add_subset_array(
+    struct dlx_universe *universe, size_t subset_size, void *subset_label,
+    const uint32_t *columns, const uint32_t *colors) {
+    size_t offsets[2] = {0, subset_size};
+
+    return dlx_universe_add_subsets(
+	universe, 1, offsets, columns, colors, &subset_label);
+}
+
+int dlx_universe_add_subsets(
+    struct dlx_universe *universe, size_t number_of_subsets,
+    const size_t *offsets, const uint32_t *columns, const uint32_t *colors,
+    void *const *subset_labels) {
+    // Check everything first so that nothing is added on error
+    for (size_t i = 0; i < number_of_subsets; ++i) {
+	if (offsets[i + 1] <= offsets[i]) {
+	    return -1;
+	}
+    }
+
+    for (size_t j = offsets[0]; j < offsets[number_of_subsets]; ++j) {
+	if (columns[j] >= universe->columns_size - 1 ||
+	    (colors && colors[j] > INT32_MAX)) {
+	    return -1;
+	}
+    }
+
+    if (reserve_nodes(
+	    universe, offsets[number_of_subsets] - offsets[0] +
+			  number_of_subsets) ||
+	reserve_subsets(universe, number_of_subsets)) {
+	return -1;
+    }
+
+    for (size_t i = 0; i < number_of_subsets; ++i) {
+	uint32_t first = (uint32_t)universe->nodes_size;
+	uint32_t node = first;
+
+	for (size_t j = offsets[i]; j < offsets[i + 1]; ++j) {
+	    add_node(universe, node++, columns[j] + 1, colors ? colors[j] : 0);
+	}
+
+	close_subset(
+	    universe, first, offsets[i + 1] - offsets[i],
+	    subset_labels ? subset_labels[i] : NULL);
+    }
+
+    return 0;
+}
+
+void search_unwind(struct dlx_universe *u) {
+    if (u->bounds) {
+	search_unwind_multiplicities(u);
+	return;
+    }
+
+    if (u->search_cells) {
+	search_unwind_cells(u);
 	return;
     }
 
-    struct dlx_node *column = choose_column(universe);
+    struct dlx_node *nodes = u->nodes;
+    uint32_t *x = u->solution_stack;
+    size_t level = u->solution_stack_size;
+
+    switch (u->search_state) {
+    case SEARCH_TRY:
+	uncover(u, u->search_column);
+	break;
+    case SEARCH_RETRY:
+	FOREACH(j, nodes, x[level], node_left) { uncommit(u, j); }
+	uncover(u, (uint32_t)nodes[x[level]].top);
+	break;
+    default:
+	break;
+    }
+
+    while (level > u->search_base) {
+	--level;
+
+	FOREACH(j, nodes, x[level], node_left) { uncommit(u, j); }
+	uncover(u, (uint32_t)nodes[x[level]].top);
+    }
+
+    u->solution_stack_size = u->search_base;
+    u->search_state = SEARCH_IDLE;
+}
+
+/* Choose `node`'s subset below the search, like the search would */
+void search_push(struct dlx_universe *u, uint32_t node) {
+    struct dlx_node *nodes = u->nodes;
+
+    cover(u, (uint32_t)nodes[node].top);
+
+    FOREACH(j, nodes, node, node_right) { commit(u, j); }
+
+    u->solution_stack[u->search_base++] = node;
+    u->solution_stack_size = u->search_base;
+}
+
+void search_pop(struct dlx_universe *u) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t node = u->solution_stack[--u->search_base];
+
+    FOREACH(j, nodes, node, node_left) { uncommit(u, j); }
+
+    uncover(u, (uint32_t)nodes[node].top);
+    u->solution_stack_size = u->search_base;
+}
+
+void dlx_universe_set_stats(
+    struct dlx_universe *universe, struct dlx_stats *stats) {
+    universe->stats = stats;
+}
+
+void dlx_universe_search_begin(
+    struct dlx_universe *universe, unsigned int desired_number_of_solutions) {
+    dlx_universe_search_abort(universe);
+
+    universe->desired_number_of_solutions = desired_number_of_solutions;
+    universe->number_of_solutions_found = 0;
+    universe->search_nodes = 0;
+    universe->deadline = seconds_now() + universe->max_seconds;
+    universe->next_progress = universe->progress_interval;
+    universe->next_checkpoint = universe->checkpoint_interval;
+    universe->search_status = DLX_SEARCH_SUSPENDED;
+    universe->search_state = SEARCH_ENTER;
+
+    // Algorithm M and symmetry breaking only run on the links, as do
+    // searches that could not allocate the cells
+    universe->search_cells = universe->backend == DLX_BACKEND_CELLS &&
+			     universe->bounds == NULL &&
+			     universe->symmetries == NULL &&
+			     cells_build(universe) == 0;
+
+    search_schedule_check(universe);
+}
+
+void dlx_universe_search_abort(struct dlx_universe *universe) {
+    if (universe->search_state != SEARCH_IDLE) {
+	search_unwind(universe);
+	universe->search_status = DLX_SEARCH_ABORTED;
+    }
+}
+
+double seconds_now(void) {
+    struct timespec now;
 
-    cover(column);
+    timespec_get(&now, TIME_UTC);
 
-    FOREACH(r, column, down) {
-	universe->solution_stack[universe->solution_stack_size++] = r;
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+/*
+ * Knuth's estimate of the fraction of the tree already explored: the choice
+ * at each level weighted by the inverse of the product of the branching
+ * factors above it, plus half of the subtree being explored. A covered
+ * column keeps its size and rows, so the branching factors can be read back
+ * from the solution stack.
+ */
+double search_progress(const struct dlx_universe *u, size_t level) {
+    if (u->bounds) {
+	return search_progress_multiplicities(u, level);
+    }
 
-	FOREACH(j, r, right) { cover(j->column); }
+    if (u->search_cells) {
+	return search_progress_cells(u, level);
+    }
 
-	dlx_universe_search(universe, desired_number_of_solutions);
+    const struct dlx_node *nodes = u->nodes;
+    double fraction = 0, weight = 1;
 
-	r = universe->solution_stack[--universe->solution_stack_size];
+    for (size_t l = u->search_base; l < level; ++l) {
+	uint32_t column = (uint32_t)nodes[u->solution_stack[l]].top;
+	uint32_t position = 0;
 
-	column = r->column;
+	FOREACH(it, nodes, column, node_down) {
+	    if (it == u->solution_stack[l]) {
+		break;
+	    }
 
-	FOREACH(j, r, left) { uncover(j->column); }
+	    ++position;
+	}
+
+	weight /= nodes[column].top;
+	fraction += position * weight;
+    }
+
+    return fraction + weight / 2;
+}
+
+void search_schedule_check(struct dlx_universe *u) {
+    uint64_t next = UINT64_MAX;
+
+    if (u->max_nodes && u->max_nodes < next) {
+	next = u->max_nodes;
+    }
 
-	if (desired_number_of_solutions &&
-	    universe->number_of_solutions_found ==
-		desired_number_of_solutions) {
+    if (u->max_seconds > 0) {
+	uint64_t tick =
+	    u->search_nodes - u->search_nodes % TIME_CHECK_INTERVAL +
+	    TIME_CHECK_INTERVAL;
+
+	next = tick < next ? tick : next;
+    }
+
+    if (u->progress && u->next_progress < next) {
+	next = u->next_progress;
+    }
+
+    if (u->checkpoint_interval && u->next_checkpoint < next) {
+	next = u->next_checkpoint;
+    }
+
+    u->next_check = next;
+}
+
+/* Returns 1 if the search must be aborted */
+int search_check(struct dlx_universe *u, size_t level) {
+    if (u->sink && sink_failed(u->sink)) {
+	return 1;
+    }
+
+    if (u->max_nodes && u->search_nodes >= u->max_nodes) {
+	return 1;
+    }
+
+    if (u->max_seconds > 0 && u->search_nodes % TIME_CHECK_INTERVAL == 0 &&
+	seconds_now() >= u->deadline) {
+	return 1;
+    }
+
+    if (u->progress && u->search_nodes >= u->next_progress) {
+	if ((*u->progress)(search_progress(u, level), u->progress_data)) {
+	    return 1;
+	}
+
+	u->next_progress += u->progress_interval;
+    }
+
+    // Only the links keep the whole search position in the solution stack,
+    // a checkpoint that could not be written is tried again next time
+    if (u->checkpoint_interval && u->search_nodes >= u->next_checkpoint) {
+	if (!u->search_cells && u->bounds == NULL) {
+	    checkpoint_write(u, u->checkpoint_path, level, SEARCH_ENTER);
+	}
+
+	u->next_checkpoint += u->checkpoint_interval;
+    }
+
+    search_schedule_check(u);
+
+    return 0;
+}
+
+void dlx_universe_set_budget(
+    struct dlx_universe *universe, uint64_t max_nodes, double max_seconds) {
+    universe->max_nodes = max_nodes;
+    universe->max_seconds = max_seconds;
+}
+
+void dlx_universe_set_progress(
+    struct dlx_universe *universe, int (*progress)(double fraction, void *data),
+    void *data, uint64_t interval) {
+    universe->progress = progress;
+    universe->progress_data = data;
+    universe->progress_interval = interval ? interval : 1;
+}
+
+int dlx_universe_search_status(struct dlx_universe *universe) {
+    return universe->search_status;
+}
+
+/*
+ * Algorithm X as a state machine, the level and the current column are kept
+ * in registers and written back to the universe whenever the search stops,
+ * so it can be resumed from the same state later.
+ *
+ * Depending on `mode` solutions are passed to the solution handler, or the
+ * search stops on them with the solution stack intact and returns
+ * SEARCH_SOLUTION, the next call backtracking from there, or they are only
+ * counted. Being inlined with a constant mode, the leaf code of the other
+ * modes is compiled out.
+ */
+static inline int search_loop(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode) {
+    if (universe->desired_number_of_solutions &&
+	universe->number_of_solutions_found ==
+	    universe->desired_number_of_solutions) {
+	dlx_universe_search_abort(universe);
+	return DLX_SEARCH_FINISHED;
+    }
+
+    struct dlx_node *nodes = universe->nodes;
+    uint32_t *x = universe->solution_stack;
+    size_t level = universe->solution_stack_size;
+    uint32_t column = universe->search_column;
+    enum search_state state = universe->search_state;
+    unsigned long nodes_visited = 0;
+
+    for (;;) {
+	switch (state) {
+	case SEARCH_ENTER:
+	    if (max_nodes && nodes_visited == max_nodes) {
+		universe->solution_stack_size = level;
+		universe->search_column = column;
+		universe->search_state = state;
+		return DLX_SEARCH_SUSPENDED;
+	    }
+
+	    if (universe->search_nodes == universe->next_check &&
+		search_check(universe, level)) {
+		universe->solution_stack_size = level;
+		universe->search_state = state;
+		search_unwind(universe);
+		return DLX_SEARCH_ABORTED;
+	    }
+
+	    ++nodes_visited;
+	    ++universe->search_nodes;
+	    STAT(universe, stats_node(stats, level));
+
+	    if (universe->symmetries && symmetry_prune(universe, level)) {
+		state = SEARCH_LEAVE;
+		break;
+	    }
+
+	    if (mode == SEARCH_COUNT) {
+		uint32_t first = universe->columns[0].right;
+
+		// With one column left every row in it is a solution, which
+		// symmetries rule out as they may not all be canonical
+		if (first == 0 || (universe->columns[first].right == 0 &&
+				   universe->symmetries == NULL)) {
+		    uint64_t found = first ? (uint64_t)nodes[first].top : 1;
+
+		    if (first == 0 && universe->symmetries) {
+			found = symmetry_orbit(universe, level);
+		    }
+
+		    universe->number_of_solutions_found += found;
+		    STAT(universe, stats->solutions += found);
+		    state = SEARCH_LEAVE;
+		    break;
+		}
+	    } else if (universe->columns[0].right == 0) {
+		universe->solution_stack_size = level;
+		dlx_solution_iterator_init(
+		    &universe->solution_iterator, universe);
+		++universe->number_of_solutions_found;
+		STAT(universe, ++stats->solutions);
+
+		if (mode == SEARCH_PULL) {
+		    universe->search_state = SEARCH_LEAVE;
+		    return SEARCH_SOLUTION;
+		}
+
+		search_report(universe);
+
+		if ((universe->desired_number_of_solutions &&
+		     universe->number_of_solutions_found ==
+			 universe->desired_number_of_solutions) ||
+		    (universe->symmetries &&
+		     symmetry_report_orbit(universe, level))) {
+		    universe->search_state = SEARCH_LEAVE;
+		    search_unwind(universe);
+		    return DLX_SEARCH_FINISHED;
+		}
+
+		state = SEARCH_LEAVE;
+		break;
+	    }
+
+	    column = choose_column(universe);
+	    cover(universe, column);
+	    x[level] = nodes[column].down;
+	    state = SEARCH_TRY;
 	    break;
+
+	case SEARCH_TRY:
+	    if (x[level] == column) {
+		uncover(universe, column);
+		state = SEARCH_LEAVE;
+		break;
+	    }
+
+	    FOREACH(j, nodes, x[level], node_right) { commit(universe, j); }
+
+	    ++level;
+	    state = SEARCH_ENTER;
+	    break;
+
+	case SEARCH_RETRY:
+	    FOREACH(j, nodes, x[level], node_left) { uncommit(universe, j); }
+
+	    column = (uint32_t)nodes[x[level]].top;
+	    x[level] = nodes[x[level]].down;
+	    state = SEARCH_TRY;
+	    break;
+
+	case SEARCH_LEAVE:
+	    if (level == universe->search_base) {
+		universe->solution_stack_size = level;
+		universe->search_state = SEARCH_IDLE;
+		return DLX_SEARCH_FINISHED;
+	    }
+
+	    --level;
+	    state = SEARCH_RETRY;
+	    break;
+
+	case SEARCH_IDLE:
+	    return DLX_SEARCH_FINISHED;
 	}
     }
+}
+
+int search_run(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode) {
+    int status;
+
+    if (universe->bounds) {
+	status = search_run_multiplicities(universe, max_nodes, mode);
+    } else if (universe->search_cells) {
+	status = search_run_cells(universe, max_nodes, mode);
+    } else if (mode == SEARCH_PULL) {
+	status = search_loop(universe, max_nodes, SEARCH_PULL);
+    } else if (mode == SEARCH_COUNT) {
+	status = search_loop(universe, max_nodes, SEARCH_COUNT);
+    } else {
+	status = search_loop(universe, max_nodes, SEARCH_HANDLER);
+    }
+
+    if (status != SEARCH_SOLUTION) {
+	universe->search_status = status;
+    }
+
+    return status;
+}
+
+int dlx_universe_search_resume(
+    struct dlx_universe *universe, unsigned long max_nodes) {
+    return search_run(universe, max_nodes, SEARCH_HANDLER);
+}
+
+struct dlx_solution_iterator *dlx_universe_next_solution(
+    struct dlx_universe *universe) {
+    if (search_run(universe, 0, SEARCH_PULL) != SEARCH_SOLUTION) {
+	return NULL;
+    }
+
+    return &universe->solution_iterator;
+}
+
+int dlx_universe_search(
+    struct dlx_universe *universe, unsigned int desired_number_of_solutions) {
+    dlx_universe_search_begin(universe, desired_number_of_solutions);
+
+    return dlx_universe_search_resume(universe, 0);
+}
+
+uint64_t dlx_universe_count(struct dlx_universe *universe) {
+    dlx_universe_search_begin(universe, DLX_ALL);
+
+    return dlx_universe_count_resume(universe);
+}
+
+uint64_t dlx_universe_count_resume(struct dlx_universe *universe) {
+    search_run(universe, 0, SEARCH_COUNT);
 
-    uncover(column);
+    return universe->number_of_solutions_found;
 }
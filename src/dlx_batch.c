@@ -0,0 +1,160 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx_internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/*
+ * Batch search: instances of one matrix that only differ in the subsets
+ * selected beforehand, e.g. the givens of sudoku puzzles, are taken in turn
+ * by a pool of threads, each selecting them on its own copy of the universe,
+ * searching and rolling the selection back for the next one.
+ */
+
+struct batch_search {
+    struct dlx_universe *universe;
+    size_t number_of_instances;
+    const size_t *offsets;
+    const size_t *subsets;
+    unsigned int desired_number_of_solutions;
+    uint64_t *solutions;
+    int *statuses;
+
+    atomic_size_t next_instance;
+    atomic_size_t number_of_instances_done;
+
+    pthread_mutex_t stats_lock;
+};
+
+// batch_search methods
+
+/* Search instance `i` on `u`, returning its status or -1 if it is invalid */
+int batch_instance(struct batch_search *b, struct dlx_universe *u, size_t i) {
+    size_t mark = dlx_universe_mark(u);
+    int status = 0;
+
+    for (size_t j = b->offsets[i]; j < b->offsets[i + 1]; ++j) {
+	if (dlx_universe_select(u, b->subsets[j])) {
+	    status = -1;
+	    break;
+	}
+    }
+
+    u->instance = i;
+    u->number_of_solutions_found = 0;
+
+    if (status == 0) {
+	status = dlx_universe_search(u, b->desired_number_of_solutions);
+    }
+
+    dlx_universe_rollback(u, mark);
+
+    return status;
+}
+
+void *batch_run(void *arg) {
+    struct batch_search *b = arg;
+    struct dlx_universe *u = universe_clone(b->universe);
+    struct dlx_stats stats = {0};
+    size_t i;
+
+    // Instances are left to the threads that could start
+    if (u == NULL) {
+	return NULL;
+    }
+
+    stats_attach(u, &stats);
+    u->progress = NULL;
+
+    while ((i = atomic_fetch_add(&b->next_instance, 1)) <
+	   b->number_of_instances) {
+	int status = batch_instance(b, u, i);
+
+	if (b->solutions) {
+	    b->solutions[i] = u->number_of_solutions_found;
+	}
+
+	if (b->statuses) {
+	    b->statuses[i] = status;
+	}
+
+	atomic_fetch_add(&b->number_of_instances_done, 1);
+    }
+
+    if (u->stats) {
+	pthread_mutex_lock(&b->stats_lock);
+	stats_merge(b->universe->stats, &stats);
+	pthread_mutex_unlock(&b->stats_lock);
+    }
+
+    free(stats.profile);
+    dlx_universe_free(u);
+
+    return NULL;
+}
+
+// dlx_universe methods
+
+int dlx_universe_search_batch(
+    struct dlx_universe *universe, size_t number_of_instances,
+    const size_t *offsets, const size_t *subsets,
+    unsigned int desired_number_of_solutions, unsigned int number_of_threads,
+    uint64_t *solutions, int *statuses) {
+    struct batch_search b = {
+	.universe = universe,
+	.number_of_instances = number_of_instances,
+	.offsets = offsets,
+	.subsets = subsets,
+	.desired_number_of_solutions = desired_number_of_solutions,
+	.solutions = solutions,
+	.statuses = statuses,
+    };
+
+    if (number_of_threads == 0) {
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	number_of_threads = online > 0 ? (unsigned int)online : 1;
+    }
+
+    if (number_of_threads > number_of_instances) {
+	number_of_threads = (unsigned int)number_of_instances;
+    }
+
+    dlx_universe_search_abort(universe);
+
+    if (number_of_instances == 0) {
+	return 0;
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * number_of_threads);
+
+    if (threads == NULL) {
+	return -1;
+    }
+
+    atomic_init(&b.next_instance, 0);
+    atomic_init(&b.number_of_instances_done, 0);
+    pthread_mutex_init(&b.stats_lock, NULL);
+
+    // The calling thread works too, so the batch completes even if no
+    // thread can be created
+    unsigned int started = 1;
+
+    while (started < number_of_threads &&
+	   pthread_create(threads + started, NULL, &batch_run, &b) == 0) {
+	++started;
+    }
+
+    batch_run(&b);
+
+    for (unsigned int i = 1; i < started; ++i) {
+	pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&b.stats_lock);
+    free(threads);
+
+    return atomic_load(&b.number_of_instances_done) == number_of_instances
+	       ? 0
+	       : -1;
+}
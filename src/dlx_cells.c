@@ -0,0 +1,589 @@
+#include "dlx_internal.h"
+#include <string.h>
+
+/*
+ * Dancing cells, Knuth's sparse-set alternative to dancing links: the nodes
+ * of every column are stored contiguously in `set`, the first `size` being
+ * the ones still active. Hiding a node swaps it with the last active one of
+ * its column and shrinks the column, undoing it only grows the column back,
+ * since nodes are restored in the reverse order they were removed. Active
+ * primary columns are a sparse set as well.
+ *
+ * Nodes keep their index in the arena, so solutions and pushed subsets are
+ * shared with the links, and the cells are copied from the current state of
+ * the links whenever a search begins.
+ */
+
+/*
+ * Hide or unhide the other nodes of `node`'s subset, updating the small
+ * columns if `tracked`, as hide_nodes and unhide_nodes on the links
+ */
+static inline uint32_t cells_hide_nodes(
+    struct dlx_cells *c, uint32_t node, int tracked) {
+    uint32_t first = node, updates = 0;
+
+    while (c->cells[first - 1].column > 0) {
+	--first;
+    }
+
+    for (uint32_t it = first; c->cells[it].column > 0; ++it) {
+	if (it == node || c->cells[it].color < 0) {
+	    continue;
+	}
+
+	uint32_t index = (uint32_t)c->cells[it].column;
+	struct dlx_cell_column *column = c->columns + index;
+	uint32_t last = column->start + --column->size;
+	uint32_t moved = c->set[last], position = c->positions[it];
+
+	c->set[position] = moved;
+	c->positions[moved] = position;
+	c->set[last] = it;
+	c->positions[it] = last;
+	++updates;
+
+	if (tracked && index <= c->small_columns.limit && column->size <= 1) {
+	    small_columns_resize(
+		&c->small_columns, index, (int32_t)column->size + 1,
+		(int32_t)column->size);
+	}
+    }
+
+    return updates;
+}
+
+static inline uint32_t cells_unhide_nodes(
+    struct dlx_cells *c, uint32_t node, int tracked) {
+    uint32_t last = node, updates = 0;
+
+    while (c->cells[last + 1].column > 0) {
+	++last;
+    }
+
+    for (uint32_t it = last; c->cells[it].column > 0; --it) {
+	if (it == node || c->cells[it].color < 0) {
+	    continue;
+	}
+
+	uint32_t index = (uint32_t)c->cells[it].column;
+	uint32_t size = ++c->columns[index].size;
+
+	++updates;
+
+	if (tracked && index <= c->small_columns.limit && size <= 2) {
+	    small_columns_resize(
+		&c->small_columns, index, (int32_t)size - 1, (int32_t)size);
+	}
+    }
+
+    return updates;
+}
+
+uint32_t cells_hide(struct dlx_cells *c, uint32_t node) {
+    return c->small_columns.limit ? cells_hide_nodes(c, node, 1)
+				  : cells_hide_nodes(c, node, 0);
+}
+
+uint32_t cells_unhide(struct dlx_cells *c, uint32_t node) {
+    return c->small_columns.limit ? cells_unhide_nodes(c, node, 1)
+				  : cells_unhide_nodes(c, node, 0);
+}
+
+void cells_cover(struct dlx_universe *u, uint32_t column) {
+    struct dlx_cells *c = u->cells;
+    struct dlx_cell_column range = c->columns[column];
+    uint64_t unlinked = 0;
+
+    if (column <= u->primary_columns_size) {
+	uint32_t last = c->active[--c->active_size];
+	uint32_t position = c->active_positions[column];
+
+	c->active[position] = last;
+	c->active_positions[last] = position;
+	c->active[c->active_size] = column;
+	c->active_positions[column] = c->active_size;
+    }
+
+    if (column <= c->small_columns.limit) {
+	small_columns_erase(&c->small_columns, column, (int32_t)range.size);
+    }
+
+    for (uint32_t i = range.start; i < range.start + range.size; ++i) {
+	unlinked += cells_hide(c, c->set[i]);
+    }
+
+    STAT(u, stats->updates += unlinked);
+}
+
+void cells_uncover(struct dlx_universe *u, uint32_t column) {
+    struct dlx_cells *c = u->cells;
+    struct dlx_cell_column range = c->columns[column];
+    uint64_t relinked = 0;
+
+    for (uint32_t i = range.start + range.size; i > range.start; --i) {
+	relinked += cells_unhide(c, c->set[i - 1]);
+    }
+
+    STAT(u, stats->updates += relinked);
+
+    if (column <= u->primary_columns_size) {
+	++c->active_size;
+    }
+
+    if (column <= c->small_columns.limit) {
+	small_columns_insert(&c->small_columns, column, (int32_t)range.size);
+    }
+}
+
+void cells_purify(struct dlx_universe *u, uint32_t node) {
+    struct dlx_cells *c = u->cells;
+    struct dlx_cell_column range = c->columns[c->cells[node].column];
+    int32_t color = c->cells[node].color;
+    uint64_t unlinked = 0;
+
+    for (uint32_t i = range.start; i < range.start + range.size; ++i) {
+	uint32_t row = c->set[i];
+
+	if (c->cells[row].color != color) {
+	    unlinked += cells_hide(c, row);
+	} else if (row != node) {
+	    c->cells[row].color = -1;
+	}
+    }
+
+    STAT(u, stats->updates += unlinked);
+}
+
+void cells_unpurify(struct dlx_universe *u, uint32_t node) {
+    struct dlx_cells *c = u->cells;
+    struct dlx_cell_column range = c->columns[c->cells[node].column];
+    int32_t color = c->cells[node].color;
+    uint64_t relinked = 0;
+
+    for (uint32_t i = range.start + range.size; i > range.start; --i) {
+	uint32_t row = c->set[i - 1];
+
+	if (c->cells[row].color < 0) {
+	    c->cells[row].color = color;
+	} else if (row != node) {
+	    relinked += cells_unhide(c, row);
+	}
+    }
+
+    STAT(u, stats->updates += relinked);
+}
+
+/* Cover or purify the columns of `node`'s subset other than its own */
+void cells_commit(struct dlx_universe *u, uint32_t node) {
+    struct dlx_cell *cells = u->cells->cells;
+    uint32_t first = node;
+
+    while (cells[first - 1].column > 0) {
+	--first;
+    }
+
+    for (uint32_t it = first; cells[it].column > 0; ++it) {
+	if (it == node) {
+	    continue;
+	}
+
+	if (cells[it].color == 0) {
+	    cells_cover(u, (uint32_t)cells[it].column);
+	} else if (cells[it].color > 0) {
+	    cells_purify(u, it);
+	}
+    }
+}
+
+void cells_uncommit(struct dlx_universe *u, uint32_t node) {
+    struct dlx_cell *cells = u->cells->cells;
+    uint32_t last = node;
+
+    while (cells[last + 1].column > 0) {
+	++last;
+    }
+
+    for (uint32_t it = last; cells[it].column > 0; --it) {
+	if (it == node) {
+	    continue;
+	}
+
+	if (cells[it].color == 0) {
+	    cells_uncover(u, (uint32_t)cells[it].column);
+	} else if (cells[it].color > 0) {
+	    cells_unpurify(u, it);
+	}
+    }
+}
+
+/*
+ * A column with the fewest rows, the first of them if it has at most one,
+ * unless another strategy is set
+ */
+uint32_t cells_choose_column(struct dlx_universe *u) {
+    const struct dlx_cells *c = u->cells;
+
+    if (u->chooser || u->choice) {
+	return cells_choose_column_strategy(u);
+    }
+
+    uint32_t column = small_columns_first(&c->small_columns);
+
+    if (column) {
+	return column;
+    }
+
+    column = c->active[0];
+
+    for (uint32_t i = 1; i < c->active_size; ++i) {
+	if (c->columns[c->active[i]].size < c->columns[column].size) {
+	    column = c->active[i];
+	}
+    }
+
+    return column;
+}
+
+/* First subset of a column, or the column itself if it is empty */
+static inline uint32_t cells_first(struct dlx_cells *c, uint32_t column) {
+    struct dlx_cell_column range = c->columns[column];
+
+    return range.size ? c->set[range.start] : column;
+}
+
+/* Subset after `node` in its column, or the column after the last one */
+static inline uint32_t cells_next(struct dlx_cells *c, uint32_t node) {
+    uint32_t column = (uint32_t)c->cells[node].column;
+    uint32_t next = c->positions[node] + 1;
+
+    return next < c->columns[column].start + c->columns[column].size
+	       ? c->set[next]
+	       : column;
+}
+
+void cells_free(struct dlx_cells *c) {
+    if (c == NULL) {
+	return;
+    }
+
+    free(c->cells);
+    free(c->positions);
+    free(c->set);
+    free(c->columns);
+    free(c->active);
+    free(c->active_positions);
+    free(c->small_columns.bits[0]);
+    free(c);
+}
+
+/*
+ * Copy the current state of the links to the cells, allocating them once.
+ * Cells built with nothing pushed are still valid after a search, which
+ * restores them, so they are only rebuilt when subsets have been added.
+ */
+int cells_build(struct dlx_universe *u) {
+    struct dlx_cells *c = u->cells;
+
+    if (c && c->nodes_size == u->nodes_size && u->search_base == 0) {
+	return 0;
+    }
+
+    if (c == NULL) {
+	c = u->cells = calloc(1, sizeof(struct dlx_cells));
+
+	if (c == NULL) {
+	    return -1;
+	}
+
+	c->columns = malloc(sizeof(struct dlx_cell_column) * u->columns_size);
+	c->active = malloc(sizeof(uint32_t) * u->columns_size);
+	c->active_positions = malloc(sizeof(uint32_t) * u->columns_size);
+
+	if (c->columns == NULL || c->active == NULL ||
+	    c->active_positions == NULL ||
+	    small_columns_init(
+		&c->small_columns, u->columns_size,
+		u->primary_columns_size)) {
+	    cells_free(c);
+	    u->cells = NULL;
+	    return -1;
+	}
+    }
+
+    // Invalid until built
+    c->nodes_size = 0;
+
+    if (c->nodes_capacity < u->nodes_size) {
+	struct dlx_cell *cells =
+	    realloc(c->cells, sizeof(struct dlx_cell) * u->nodes_size);
+
+	if (cells == NULL) {
+	    return -1;
+	}
+
+	c->cells = cells;
+
+	uint32_t *positions =
+	    realloc(c->positions, sizeof(uint32_t) * u->nodes_size);
+
+	if (positions == NULL) {
+	    return -1;
+	}
+
+	c->positions = positions;
+
+	uint32_t *set = realloc(c->set, sizeof(uint32_t) * u->nodes_size);
+
+	if (set == NULL) {
+	    return -1;
+	}
+
+	c->set = set;
+	c->nodes_capacity = u->nodes_size;
+    }
+
+    const struct dlx_node *nodes = u->nodes;
+
+    // Headers are never reached from subsets, the spacer after them stops
+    // the walks of the first one
+    for (size_t i = 0; i < u->nodes_size; ++i) {
+	c->cells[i].column = i < u->columns_size ? 0 : nodes[i].top;
+	c->cells[i].color = nodes[i].color;
+    }
+
+    uint32_t size = 0;
+
+    for (uint32_t column = 1; column < u->columns_size; ++column) {
+	c->columns[column].start = size;
+	c->columns[column].size = 0;
+	size += (uint32_t)nodes[column].top;
+    }
+
+    if (u->search_base == 0 && !u->rows_reordered) {
+	// Nothing is covered, so the columns hold all their nodes, in the
+	// reverse order of the arena, and can be filled sequentially
+	for (size_t i = u->nodes_size - 1; i > u->columns_size; --i) {
+	    if (nodes[i].top > 0) {
+		struct dlx_cell_column *column = c->columns + nodes[i].top;
+		uint32_t position = column->start + column->size++;
+
+		c->set[position] = (uint32_t)i;
+		c->positions[i] = position;
+	    }
+	}
+    } else {
+	for (uint32_t column = 1; column < u->columns_size; ++column) {
+	    struct dlx_cell_column *range = c->columns + column;
+
+	    FOREACH(row, nodes, column, node_down) {
+		c->set[range->start + range->size] = row;
+		c->positions[row] = range->start + range->size++;
+	    }
+	}
+    }
+
+    c->active_size = 0;
+    memset(
+	c->small_columns.bits[0], 0,
+	sizeof(uint64_t) * 2 * ((u->columns_size + 63) / 64));
+    c->small_columns.counts[0] = c->small_columns.counts[1] = 0;
+
+    for (uint32_t it = u->columns[0].right; it != 0;
+	 it = u->columns[it].right) {
+	c->active[c->active_size] = it;
+	c->active_positions[it] = c->active_size++;
+
+	if (it <= c->small_columns.limit) {
+	    small_columns_insert(
+		&c->small_columns, it, (int32_t)c->columns[it].size);
+	}
+    }
+
+    c->nodes_size = u->search_base == 0 ? u->nodes_size : 0;
+
+    return 0;
+}
+
+double search_progress_cells(const struct dlx_universe *u, size_t level) {
+    const struct dlx_cells *c = u->cells;
+    double fraction = 0, weight = 1;
+
+    for (size_t l = u->search_base; l < level; ++l) {
+	uint32_t node = u->solution_stack[l];
+	struct dlx_cell_column range = c->columns[c->cells[node].column];
+
+	weight /= range.size;
+	fraction += (c->positions[node] - range.start) * weight;
+    }
+
+    return fraction + weight / 2;
+}
+
+void search_unwind_cells(struct dlx_universe *u) {
+    uint32_t *x = u->solution_stack;
+    size_t level = u->solution_stack_size;
+
+    switch (u->search_state) {
+    case SEARCH_TRY:
+	cells_uncover(u, u->search_column);
+	break;
+    case SEARCH_RETRY:
+	cells_uncommit(u, x[level]);
+	cells_uncover(u, (uint32_t)u->cells->cells[x[level]].column);
+	break;
+    default:
+	break;
+    }
+
+    while (level > u->search_base) {
+	--level;
+
+	cells_uncommit(u, x[level]);
+	cells_uncover(u, (uint32_t)u->cells->cells[x[level]].column);
+    }
+
+    u->solution_stack_size = u->search_base;
+    u->search_state = SEARCH_IDLE;
+}
+
+/* search_loop on the cells */
+static inline int search_loop_cells(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode) {
+    if (universe->desired_number_of_solutions &&
+	universe->number_of_solutions_found ==
+	    universe->desired_number_of_solutions) {
+	dlx_universe_search_abort(universe);
+	return DLX_SEARCH_FINISHED;
+    }
+
+    struct dlx_cells *c = universe->cells;
+    uint32_t *x = universe->solution_stack;
+    size_t level = universe->solution_stack_size;
+    uint32_t column = universe->search_column;
+    enum search_state state = universe->search_state;
+    unsigned long nodes_visited = 0;
+
+    for (;;) {
+	switch (state) {
+	case SEARCH_ENTER:
+	    if (max_nodes && nodes_visited == max_nodes) {
+		universe->solution_stack_size = level;
+		universe->search_column = column;
+		universe->search_state = state;
+		return DLX_SEARCH_SUSPENDED;
+	    }
+
+	    if (universe->search_nodes == universe->next_check &&
+		search_check(universe, level)) {
+		universe->solution_stack_size = level;
+		universe->search_state = state;
+		search_unwind(universe);
+		return DLX_SEARCH_ABORTED;
+	    }
+
+	    ++nodes_visited;
+	    ++universe->search_nodes;
+	    STAT(universe, stats_node(stats, level));
+
+	    if (mode == SEARCH_COUNT) {
+		// With one column left every row in it is a solution
+		if (c->active_size <= 1) {
+		    uint64_t found =
+			c->active_size == 0 ? 1
+					    : c->columns[c->active[0]].size;
+
+		    universe->number_of_solutions_found += found;
+		    STAT(universe, stats->solutions += found);
+		    state = SEARCH_LEAVE;
+		    break;
+		}
+	    } else if (c->active_size == 0) {
+		universe->solution_stack_size = level;
+		dlx_solution_iterator_init(
+		    &universe->solution_iterator, universe);
+		++universe->number_of_solutions_found;
+		STAT(universe, ++stats->solutions);
+
+		if (mode == SEARCH_PULL) {
+		    universe->search_state = SEARCH_LEAVE;
+		    return SEARCH_SOLUTION;
+		}
+
+		search_report(universe);
+
+		if (universe->desired_number_of_solutions &&
+		    universe->number_of_solutions_found ==
+			universe->desired_number_of_solutions) {
+		    universe->search_state = SEARCH_LEAVE;
+		    search_unwind(universe);
+		    return DLX_SEARCH_FINISHED;
+		}
+
+		state = SEARCH_LEAVE;
+		break;
+	    }
+
+	    column = cells_choose_column(universe);
+	    cells_cover(universe, column);
+	    x[level] = cells_first(c, column);
+	    state = SEARCH_TRY;
+	    break;
+
+	case SEARCH_TRY:
+	    if (x[level] == column) {
+		cells_uncover(universe, column);
+		state = SEARCH_LEAVE;
+		break;
+	    }
+
+	    cells_commit(universe, x[level]);
+
+	    ++level;
+	    state = SEARCH_ENTER;
+	    break;
+
+	case SEARCH_RETRY:
+	    cells_uncommit(universe, x[level]);
+
+	    column = (uint32_t)c->cells[x[level]].column;
+	    x[level] = cells_next(c, x[level]);
+	    state = SEARCH_TRY;
+	    break;
+
+	case SEARCH_LEAVE:
+	    if (level == universe->search_base) {
+		universe->solution_stack_size = level;
+		universe->search_state = SEARCH_IDLE;
+		return DLX_SEARCH_FINISHED;
+	    }
+
+	    --level;
+	    state = SEARCH_RETRY;
+	    break;
+
+	case SEARCH_IDLE:
+	    return DLX_SEARCH_FINISHED;
+	}
+    }
+}
+
+int search_run_cells(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode) {
+    switch (mode) {
+    case SEARCH_PULL:
+	return search_loop_cells(universe, max_nodes, SEARCH_PULL);
+    case SEARCH_COUNT:
+	return search_loop_cells(universe, max_nodes, SEARCH_COUNT);
+    default:
+	return search_loop_cells(universe, max_nodes, SEARCH_HANDLER);
+    }
+}
+
+// dlx_universe methods
+
+void dlx_universe_set_backend(struct dlx_universe *universe, int backend) {
+    dlx_universe_search_abort(universe);
+    universe->backend = backend;
+}
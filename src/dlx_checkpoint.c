@@ -0,0 +1,267 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx_internal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Checkpoints of a search on the links, in the byte order of the machine
+ * that wrote them: a header with the counters and the shape of the matrix,
+ * then the node chosen at each level above the subsets selected
+ * beforehand. Covering the column of each node and committing its row in
+ * turn brings the links back to where the search was, which is all the
+ * state it has. They are written to a temporary file renamed over the
+ * previous one, so that a checkpoint is either whole or not there.
+ */
+
+#define CHECKPOINT_MAGIC "DLXCKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_BYTE_ORDER 0x01020304
+
+struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t columns_size;
+    uint64_t primary_columns_size;
+    uint64_t nodes_size;
+    uint64_t subsets_size;
+    uint64_t search_base;
+    uint64_t levels;
+    uint32_t search_state;
+    uint32_t desired_number_of_solutions;
+    uint64_t number_of_solutions_found;
+
+    // Statistics gathered so far, if any
+    uint64_t nodes;
+    uint64_t updates;
+    uint64_t solutions;
+};
+
+/* Flush the directory of `path`, for a rename in it to be on disk too */
+int checkpoint_sync_directory(const char *path) {
+    const char *slash = strrchr(path, '/');
+    size_t length = slash == path ? 1 : slash ? (size_t)(slash - path) : 0;
+    char *directory = malloc(length + 2);
+
+    if (directory == NULL) {
+	return -1;
+    }
+
+    if (slash) {
+	memcpy(directory, path, length);
+	directory[length] = '\0';
+    } else {
+	memcpy(directory, ".", 2);
+    }
+
+    int fd = open(directory, O_RDONLY);
+
+    free(directory);
+
+    if (fd < 0) {
+	return -1;
+    }
+
+    int error = fsync(fd);
+
+    return close(fd) || error ? -1 : 0;
+}
+
+/* Write the search, with the nodes of the levels below `level` chosen */
+int checkpoint_write(
+    const struct dlx_universe *u, const char *path, size_t level,
+    enum search_state state) {
+    struct checkpoint_header header = {
+	.magic = CHECKPOINT_MAGIC,
+	.version = CHECKPOINT_VERSION,
+	.byte_order = CHECKPOINT_BYTE_ORDER,
+	.columns_size = u->columns_size,
+	.primary_columns_size = u->primary_columns_size,
+	.nodes_size = u->nodes_size,
+	.subsets_size = u->subsets_size,
+	.search_base = u->search_base,
+	.levels = level - u->search_base,
+	.search_state = state,
+	.desired_number_of_solutions = u->desired_number_of_solutions,
+	.number_of_solutions_found = u->number_of_solutions_found,
+    };
+
+    if (u->stats) {
+	header.nodes = u->stats->nodes;
+	header.updates = u->stats->updates;
+	header.solutions = u->stats->solutions;
+    }
+
+    size_t length = strlen(path);
+    char *temporary = malloc(length + sizeof(".tmp"));
+
+    if (temporary == NULL) {
+	return -1;
+    }
+
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+
+    FILE *file = fopen(temporary, "wb");
+
+    if (file == NULL) {
+	free(temporary);
+	return -1;
+    }
+
+    // The rename only replaces the previous checkpoint once the new one is
+    // on disk
+    int error = fwrite(&header, sizeof(header), 1, file) != 1 ||
+		fwrite(
+		    u->solution_stack + u->search_base, sizeof(uint32_t),
+		    header.levels, file) != header.levels ||
+		fflush(file) || fsync(fileno(file));
+
+    if (fclose(file) || error || rename(temporary, path)) {
+	remove(temporary);
+	free(temporary);
+	return -1;
+    }
+
+    free(temporary);
+
+    return checkpoint_sync_directory(path);
+}
+
+/* Whether node `node` can be chosen next, like the search would */
+int checkpoint_choosable(const struct dlx_universe *u, uint32_t node) {
+    const struct dlx_node *nodes = u->nodes;
+    const struct dlx_column *columns = u->columns;
+
+    if (node < u->columns_size || node >= u->nodes_size ||
+	nodes[node].top <= 0) {
+	return 0;
+    }
+
+    uint32_t column = (uint32_t)nodes[node].top;
+
+    return column <= u->primary_columns_size &&
+	   columns[columns[column].left].right == column &&
+	   nodes[nodes[node].up].down == node;
+}
+
+// dlx_universe methods
+
+void dlx_universe_set_checkpoint(
+    struct dlx_universe *universe, const char *path, uint64_t interval) {
+    free(universe->checkpoint_path);
+    universe->checkpoint_path = NULL;
+    universe->checkpoint_interval = 0;
+
+    if (path == NULL || interval == 0) {
+	return;
+    }
+
+    size_t size = strlen(path) + 1;
+
+    universe->checkpoint_path = malloc(size);
+
+    if (universe->checkpoint_path) {
+	memcpy(universe->checkpoint_path, path, size);
+	universe->checkpoint_interval = interval;
+    }
+}
+
+int dlx_universe_checkpoint(struct dlx_universe *universe, const char *path) {
+    if (universe->search_state != SEARCH_ENTER &&
+	universe->search_state != SEARCH_LEAVE) {
+	return -1;
+    }
+
+    if (universe->search_cells || universe->bounds) {
+	return -1;
+    }
+
+    return checkpoint_write(
+	universe, path, universe->solution_stack_size, universe->search_state);
+}
+
+int dlx_universe_restore(struct dlx_universe *universe, const char *path) {
+    struct checkpoint_header header;
+    uint32_t *levels = NULL;
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+	return -1;
+    }
+
+    int error =
+	fread(&header, sizeof(header), 1, file) != 1 ||
+	memcmp(header.magic, CHECKPOINT_MAGIC, 8) != 0 ||
+	header.version != CHECKPOINT_VERSION ||
+	header.byte_order != CHECKPOINT_BYTE_ORDER ||
+	header.columns_size != universe->columns_size ||
+	header.primary_columns_size != universe->primary_columns_size ||
+	header.nodes_size != universe->nodes_size ||
+	header.subsets_size != universe->subsets_size ||
+	header.search_base != universe->search_base ||
+	header.levels >
+	    universe->solution_stack_capacity - header.search_base ||
+	(header.search_state != SEARCH_ENTER &&
+	 header.search_state != SEARCH_LEAVE) ||
+	universe->backend == DLX_BACKEND_CELLS || universe->bounds;
+
+    if (!error) {
+	levels = malloc(sizeof(uint32_t) * (header.levels + 1));
+	error = levels == NULL ||
+		fread(levels, sizeof(uint32_t), header.levels, file) !=
+		    header.levels ||
+		getc(file) != EOF;
+    }
+
+    fclose(file);
+
+    if (error) {
+	free(levels);
+	return -1;
+    }
+
+    dlx_universe_search_begin(universe, header.desired_number_of_solutions);
+
+    // The nodes are pushed like selected subsets, then handed to the search,
+    // their updates being counted already
+    struct dlx_stats *stats = universe->stats;
+    size_t base = universe->search_base, level = 0;
+
+    universe->stats = NULL;
+
+    while (level < header.levels &&
+	   checkpoint_choosable(universe, levels[level])) {
+	search_push(universe, levels[level++]);
+    }
+
+    free(levels);
+
+    if (level < header.levels) {
+	while (level--) {
+	    search_pop(universe);
+	}
+
+	universe->stats = stats;
+	universe->search_state = SEARCH_IDLE;
+	universe->search_status = DLX_SEARCH_ABORTED;
+
+	return -1;
+    }
+
+    universe->stats = stats;
+    universe->search_base = base;
+    universe->search_state = header.search_state;
+    universe->number_of_solutions_found = header.number_of_solutions_found;
+
+    if (universe->stats) {
+	universe->stats->nodes += header.nodes;
+	universe->stats->updates += header.updates;
+	universe->stats->solutions += header.solutions;
+    }
+
+    return 0;
+}
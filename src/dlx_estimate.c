@@ -0,0 +1,162 @@
+#include "dlx_internal.h"
+#include <math.h>
+
+/*
+ * Knuth's estimate of the size of a backtrack tree: a random walk from the
+ * root, taking one of the d rows of the column chosen at every node, stands
+ * for the d subtrees below it, so that the node reached at depth k counts as
+ * the product of the branching factors above it. The mean of these products
+ * over many walks is an unbiased estimate of the number of nodes at depth k,
+ * and likewise of solutions and of the updates made along the way.
+ */
+
+/* Running mean and variance of one estimate, by Welford's method */
+struct estimate_moments {
+    double mean;
+    double squares;
+};
+
+// estimate_moments methods
+
+void estimate_moments_add(struct estimate_moments *m, double x, uint64_t n) {
+    double delta = x - m->mean;
+
+    m->mean += delta / (double)n;
+    m->squares += delta * (x - m->mean);
+}
+
+/* Standard error of the mean of the `n` values added */
+double estimate_moments_error(const struct estimate_moments *m, uint64_t n) {
+    return n > 1 ? sqrt(m->squares / (double)(n - 1) / (double)n) : INFINITY;
+}
+
+// dlx_universe methods
+
+/*
+ * One random walk from where the search would begin, adding the nodes it
+ * stands for at each depth to `profile`, if any, and leaving the matrix as
+ * it was. Updates are read from statistics of its own, so they are only
+ * estimated with statistics compiled in.
+ */
+void estimate_probe(
+    struct dlx_universe *u, uint64_t *state, double *nodes_found,
+    double *solutions_found, double *updates_found, double *profile,
+    size_t profile_size) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t *x = u->solution_stack;
+    struct dlx_stats *saved = u->stats;
+    struct dlx_stats stats = {0};
+    size_t level = u->search_base;
+    double weight = 1;
+
+    *nodes_found = *solutions_found = *updates_found = 0;
+    u->stats = &stats;
+
+    for (;;) {
+	size_t depth = level - u->search_base;
+
+	*nodes_found += weight;
+
+	if (profile && depth < profile_size) {
+	    profile[depth] += weight;
+	}
+
+	if (u->symmetries && symmetry_prune(u, level)) {
+	    break;
+	}
+
+	if (u->columns[0].right == 0) {
+	    *solutions_found =
+		u->symmetries ? weight * (double)symmetry_orbit(u, level)
+			      : weight;
+	    break;
+	}
+
+	uint32_t column = choose_column(u);
+	int32_t size = nodes[column].top;
+
+	if (size == 0) {
+	    break;
+	}
+
+	// Every row is tried and undone, and the column uncovered, at the
+	// cost of the row taken
+	uint64_t updates = stats.updates;
+	uint32_t row = nodes[column].down;
+
+	cover(u, column);
+
+	for (uint64_t i = random_below(state, (uint64_t)size); i; --i) {
+	    row = nodes[row].down;
+	}
+
+	uint64_t cover_updates = stats.updates - updates;
+
+	updates = stats.updates;
+	FOREACH(j, nodes, row, node_right) { commit(u, j); }
+	x[level++] = row;
+
+	*updates_found += weight * 2 *
+			  (double)(cover_updates +
+				   (uint64_t)size * (stats.updates - updates));
+	weight *= size;
+    }
+
+    while (level > u->search_base) {
+	uint32_t row = x[--level];
+
+	FOREACH(j, nodes, row, node_left) { uncommit(u, j); }
+	uncover(u, (uint32_t)nodes[row].top);
+    }
+
+    u->stats = saved;
+}
+
+int dlx_universe_estimate(
+    struct dlx_universe *universe, uint64_t probes, uint64_t seed,
+    struct dlx_estimate *estimate) {
+    if (universe->search_state != SEARCH_IDLE || universe->bounds ||
+	probes == 0) {
+	return -1;
+    }
+
+    struct estimate_moments nodes = {0}, solutions = {0}, updates = {0};
+    uint64_t random_state = universe->random_state;
+
+    // Random column choices draw from the seed rather than the universe's
+    // generator, which later searches find as they left it
+    universe->random_state = random_next(&seed);
+
+    if (estimate->profile) {
+	for (size_t i = 0; i < estimate->profile_size; ++i) {
+	    estimate->profile[i] = 0;
+	}
+    }
+
+    for (uint64_t n = 1; n <= probes; ++n) {
+	double nodes_found, solutions_found, updates_found;
+
+	estimate_probe(
+	    universe, &seed, &nodes_found, &solutions_found, &updates_found,
+	    estimate->profile, estimate->profile_size);
+	estimate_moments_add(&nodes, nodes_found, n);
+	estimate_moments_add(&solutions, solutions_found, n);
+	estimate_moments_add(&updates, updates_found, n);
+    }
+
+    if (estimate->profile) {
+	for (size_t i = 0; i < estimate->profile_size; ++i) {
+	    estimate->profile[i] /= (double)probes;
+	}
+    }
+
+    universe->random_state = random_state;
+    estimate->nodes = nodes.mean;
+    estimate->solutions = solutions.mean;
+    estimate->updates = updates.mean;
+    estimate->nodes_error = estimate_moments_error(&nodes, probes);
+    estimate->solutions_error = estimate_moments_error(&solutions, probes);
+    estimate->updates_error = estimate_moments_error(&updates, probes);
+
+    return 0;
+}
@@ -0,0 +1,441 @@
+#ifndef __DLX_INTERNAL_H__
+#define __DLX_INTERNAL_H__
+
+#include "dlx.h"
+#include <stdint.h>
+
+#define FOREACH(it, nodes, node, direction)                                    \
+    for (uint32_t it = direction(nodes, node); it != (node);                   \
+	 it = direction(nodes, it))
+
+/*
+ * Statistics are only gathered when a stats struct has been set, defining
+ * DLX_NO_STATS compiles the counters out altogether.
+ */
+#ifdef DLX_NO_STATS
+#define STAT(u, expr) ((void)0)
+#else
+#define STAT(u, expr)                                                          \
+    do {                                                                       \
+	struct dlx_stats *stats = (u)->stats;                                  \
+									       \
+	if (stats) {                                                           \
+	    expr;                                                              \
+	}                                                                      \
+    } while (0)
+#endif
+
+/*
+ * All nodes live in one arena and refer to each other by index, following
+ * the sequential layout of Knuth's DLX1: node i is the header of column i
+ * (with i = 0 unused), and the nodes of every subset are stored
+ * contiguously between two spacers, so horizontal neighbours are implicit.
+ *
+ * For headers `top` is the size of the column, for regular nodes the index
+ * of their column and for spacers minus the index of the following subset.
+ * A spacer's `up` is the first node of the previous subset and its `down`
+ * the last node of the next one.
+ *
+ * Nodes of secondary columns may have a positive color, as in Knuth's
+ * Algorithm C: choosing a subset with a colored node purifies the column,
+ * hiding the subsets with other colors and setting the color of the ones
+ * sharing it to -1 so they are left alone until the column is unpurified.
+ */
+struct dlx_node {
+    int32_t top;
+    uint32_t up, down;
+    int32_t color;
+};
+
+/* Column headers, index 0 is the root of the list of active columns */
+struct dlx_column {
+    uint32_t left, right;
+};
+
+/*
+ * Bounds of a primary column once any has been set: how many more subsets
+ * may cover it and the difference between its upper and lower bounds.
+ */
+struct dlx_bounds {
+    int32_t bound, slack;
+};
+
+/*
+ * Symmetries added with dlx_universe_add_symmetry: the permutations of the
+ * subset indices they make, the group they generate without the identity in
+ * `images`, and per search node marks telling which subsets are known to be
+ * in or out of the solution.
+ */
+struct dlx_symmetries {
+    uint32_t *generators;
+    size_t generators_size;
+    uint32_t *images;
+    size_t *inverses;
+    size_t size;
+    size_t subsets_size;
+    uint32_t *first_nodes;
+    uint64_t *marks;
+    uint64_t epoch;
+
+    // Subsets of the solution being compared and nodes of its images
+    uint32_t *subsets;
+    uint32_t *solution;
+};
+
+/*
+ * Active primary columns with no row and with one row, as bitsets over the
+ * column indices. The active list is always in index order, so the lowest
+ * bit of the first non-empty set is the column the scan of choose_column
+ * would find, without walking the list in the common case of an empty or
+ * forced column.
+ */
+struct dlx_small_columns {
+    uint64_t *bits[2];
+    size_t counts[2];
+    uint32_t limit;
+};
+
+/*
+ * Below this many primary columns scanning them is cheaper than keeping the
+ * bitsets up to date, and their `limit`, the last column tracked, is 0
+ */
+#define SMALL_COLUMNS_THRESHOLD 64
+
+/* Dancing cells, see dlx_cells.c, `column` is as `top` for subset nodes */
+struct dlx_cell {
+    int32_t column;
+    int32_t color;
+};
+
+struct dlx_cell_column {
+    uint32_t start, size;
+};
+
+struct dlx_cells {
+    struct dlx_cell *cells;
+    uint32_t *positions;
+    uint32_t *set;
+    size_t nodes_capacity;
+
+    // Size of the arena the cells were built from with nothing pushed
+    size_t nodes_size;
+
+    struct dlx_cell_column *columns;
+    uint32_t *active;
+    uint32_t *active_positions;
+    uint32_t active_size;
+    struct dlx_small_columns small_columns;
+};
+
+struct dlx_solution_iterator {
+    const struct dlx_node *nodes;
+    void *const *subset_labels;
+    const uint32_t *solutions;
+    size_t index;
+    size_t end;
+    size_t instance;
+};
+
+// Internal status of search_run, beyond the public DLX_SEARCH_* ones
+#define SEARCH_SOLUTION 3
+
+// Nodes between two looks at the clock when there is a time budget
+#define TIME_CHECK_INTERVAL 1024
+
+/* What search_run does on every solution */
+enum search_mode {
+    SEARCH_HANDLER,
+    SEARCH_PULL,
+    SEARCH_COUNT,
+};
+
+enum search_state {
+    SEARCH_IDLE,
+    SEARCH_ENTER,
+    SEARCH_TRY,
+    SEARCH_RETRY,
+    SEARCH_LEAVE,
+};
+
+struct dlx_universe {
+    struct dlx_column *columns;
+    size_t columns_size;
+    size_t primary_columns_size;
+    struct dlx_small_columns small_columns;
+
+    struct dlx_node *nodes;
+    size_t nodes_size;
+    size_t nodes_capacity;
+
+    // Snapshot holding the nodes of a loaded universe until the arena grows
+    void *mapping;
+    size_t mapping_size;
+
+    void **subset_labels;
+    size_t subsets_size;
+    size_t subsets_capacity;
+
+    // Levels below `search_base` hold subsets pushed with search_push, the
+    // search never backtracks past them
+    uint32_t *solution_stack;
+    size_t solution_stack_size;
+    size_t solution_stack_capacity;
+    size_t search_base;
+
+    // Steps of dlx_universe_reduce and dlx_universe_select, forced and
+    // selected rows being pushed below the search
+    uint32_t *reduce_log;
+    size_t reduce_log_size;
+    size_t reduce_log_capacity;
+
+    // First node of the subsets, indexed as they get selected
+    uint32_t *subset_nodes;
+    size_t subset_nodes_size;
+    size_t subset_nodes_capacity;
+
+    // Set by dlx_universe_set_bounds, `first_tweaks` and `solution_subsets`
+    // are only used by Algorithm M
+    struct dlx_bounds *bounds;
+    size_t bounds_total;
+    uint32_t *first_tweaks;
+    uint32_t *solution_subsets;
+
+    // Set by dlx_universe_add_symmetry and dlx_universe_set_symmetry_report
+    struct dlx_symmetries *symmetries;
+    int symmetry_report;
+
+    // The cells are built from the links when a search begins with the cells
+    // backend, `search_cells` telling which ones the search runs on
+    int backend;
+    struct dlx_cells *cells;
+    int search_cells;
+
+    // Set by dlx_universe_set_choice and dlx_universe_set_chooser, which is
+    // passed the active primary columns in `chooser_columns`
+    int choice;
+    uint64_t random_state;
+    size_t (*chooser)(
+	const size_t *columns, const size_t *sizes, size_t count, void *data);
+    void *chooser_data;
+    size_t *chooser_columns;
+    size_t *chooser_sizes;
+
+    // Set once the rows no longer follow the reverse order of the arena
+    int rows_reordered;
+
+    enum search_state search_state;
+    uint32_t search_column;
+    unsigned int desired_number_of_solutions;
+
+    // Budgets and progress reports are handled when `search_nodes`, the
+    // nodes visited by the current search, reaches `next_check`
+    uint64_t search_nodes;
+    uint64_t next_check;
+    uint64_t max_nodes;
+    double max_seconds;
+    double deadline;
+    int (*progress)(double fraction, void *data);
+    void *progress_data;
+    uint64_t progress_interval;
+    uint64_t next_progress;
+    int search_status;
+
+    // Set by dlx_universe_set_checkpoint, copies of the universe made for
+    // other threads never write checkpoints
+    char *checkpoint_path;
+    uint64_t checkpoint_interval;
+    uint64_t next_checkpoint;
+
+    struct dlx_stats *stats;
+
+    void (*solution_handler)(struct dlx_solution_iterator *iter);
+    struct dlx_solution_iterator solution_iterator;
+
+    // Set by dlx_universe_search_sink, takes the solutions instead of the
+    // solution handler
+    struct dlx_sink *sink;
+
+    // Instance of dlx_universe_search_batch being searched
+    size_t instance;
+    uint64_t number_of_solutions_found;
+};
+
+// dlx_node methods
+
+static inline uint32_t node_up(const struct dlx_node *nodes, uint32_t node) {
+    return nodes[node].up;
+}
+
+static inline uint32_t node_down(const struct dlx_node *nodes, uint32_t node) {
+    return nodes[node].down;
+}
+
+static inline uint32_t node_left(const struct dlx_node *nodes, uint32_t node) {
+    return nodes[node - 1].top <= 0 ? nodes[node - 1].down : node - 1;
+}
+
+static inline uint32_t node_right(const struct dlx_node *nodes, uint32_t node) {
+    return nodes[node + 1].top <= 0 ? nodes[node + 1].up : node + 1;
+}
+
+// dlx_small_columns methods
+
+static inline void small_columns_insert(
+    struct dlx_small_columns *s, uint32_t column, int32_t size) {
+    if (size <= 1) {
+	s->bits[size][column / 64] |= (uint64_t)1 << column % 64;
+	++s->counts[size];
+    }
+}
+
+static inline void small_columns_erase(
+    struct dlx_small_columns *s, uint32_t column, int32_t size) {
+    if (size <= 1) {
+	s->bits[size][column / 64] &= ~((uint64_t)1 << column % 64);
+	--s->counts[size];
+    }
+}
+
+/* A column's size changed from `from` to `to`, with either at most one */
+static inline void small_columns_resize(
+    struct dlx_small_columns *s, uint32_t column, int32_t from, int32_t to) {
+    small_columns_erase(s, column, from);
+    small_columns_insert(s, column, to);
+}
+
+/* First column with the fewest rows, if it has at most one, or else 0 */
+static inline uint32_t small_columns_first(const struct dlx_small_columns *s) {
+    const uint64_t *bits;
+
+    if (s->counts[0]) {
+	bits = s->bits[0];
+    } else if (s->counts[1]) {
+	bits = s->bits[1];
+    } else {
+	return 0;
+    }
+
+    size_t i = 0;
+
+    while (bits[i] == 0) {
+	++i;
+    }
+
+    return (uint32_t)(i * 64 + (size_t)__builtin_ctzll(bits[i]));
+}
+
+/* Functions shared between the library sources */
+
+int small_columns_init(
+    struct dlx_small_columns *s, size_t columns_size,
+    size_t primary_columns_size);
+
+size_t subset_index(const struct dlx_node *nodes, uint32_t node);
+
+uint32_t hide(struct dlx_universe *u, uint32_t node);
+
+uint32_t unhide(struct dlx_universe *u, uint32_t node);
+
+void dlx_solution_iterator_init(
+    struct dlx_solution_iterator *iter, struct dlx_universe *universe);
+
+void cover(struct dlx_universe *u, uint32_t column);
+
+void uncover(struct dlx_universe *u, uint32_t column);
+
+void commit(struct dlx_universe *u, uint32_t node);
+
+void uncommit(struct dlx_universe *u, uint32_t node);
+
+uint32_t choose_column(struct dlx_universe *u);
+
+void stats_node(struct dlx_stats *stats, size_t level);
+
+double seconds_now(void);
+
+void search_schedule_check(struct dlx_universe *u);
+
+int search_check(struct dlx_universe *u, size_t level);
+
+void search_unwind(struct dlx_universe *u);
+
+void search_push(struct dlx_universe *u, uint32_t node);
+
+void search_pop(struct dlx_universe *u);
+
+struct dlx_universe *universe_clone(const struct dlx_universe *u);
+
+void stats_merge(struct dlx_stats *stats, const struct dlx_stats *worker);
+
+void stats_attach(struct dlx_universe *u, struct dlx_stats *stats);
+
+int search_run(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode);
+
+void cells_free(struct dlx_cells *c);
+
+int cells_build(struct dlx_universe *u);
+
+double search_progress_cells(const struct dlx_universe *u, size_t level);
+
+void search_unwind_cells(struct dlx_universe *u);
+
+int search_run_cells(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode);
+
+double search_progress_multiplicities(
+    const struct dlx_universe *u, size_t level);
+
+void search_unwind_multiplicities(struct dlx_universe *u);
+
+int search_run_multiplicities(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode);
+
+void snapshot_unmap(struct dlx_universe *u);
+
+uint64_t random_next(uint64_t *state);
+
+uint64_t random_below(uint64_t *state, uint64_t n);
+
+uint32_t choose_column_strategy(struct dlx_universe *u);
+
+uint32_t cells_choose_column_strategy(struct dlx_universe *u);
+
+int chooser_reserve(struct dlx_universe *u);
+
+void rows_reordered(struct dlx_universe *u);
+
+void sink_append(struct dlx_universe *u);
+
+int sink_failed(const struct dlx_sink *s);
+
+int checkpoint_write(
+    const struct dlx_universe *u, const char *path, size_t level,
+    enum search_state state);
+
+uint32_t subset_first(struct dlx_universe *u, size_t subset);
+
+void symmetries_free(struct dlx_symmetries *s);
+
+struct dlx_symmetries *symmetries_clone(
+    const struct dlx_symmetries *s, size_t levels);
+
+int symmetry_prune(struct dlx_universe *u, size_t level);
+
+uint64_t symmetry_orbit(const struct dlx_universe *u, size_t level);
+
+int symmetry_report_orbit(struct dlx_universe *u, size_t level);
+
+/* Pass the solution in the iterator to the sink, if any, or the handler */
+static inline void search_report(struct dlx_universe *u) {
+    if (u->sink) {
+	sink_append(u);
+    } else {
+	(*u->solution_handler)(&u->solution_iterator);
+    }
+}
+
+#endif
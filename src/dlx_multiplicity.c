@@ -0,0 +1,501 @@
+#include "dlx_internal.h"
+
+/*
+ * Knuth's Algorithm M, exact covering with multiplicities: every primary
+ * column must be covered by between `lo` and `hi` of the chosen subsets,
+ * `bound` counting how many more may still cover it.
+ *
+ * A column is branched on once for every subset covering it, so to visit
+ * each combination once instead of every permutation the subsets tried at a
+ * level are "tweaked" out of the column for the levels below, starting from
+ * `first_tweaks[level]`. The last branch of a level puts the column itself
+ * on the solution stack, deactivating it with no more subsets.
+ */
+
+/* Remove `node`, the first subset left in `column`, for the levels below */
+void tweak(struct dlx_universe *u, uint32_t node, uint32_t column) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t down = nodes[node].down;
+    uint64_t unlinked = 0;
+
+    // The subsets of a covered column are hidden already
+    if (u->bounds[column].bound != 0) {
+	unlinked += hide(u, node);
+    }
+
+    STAT(u, stats->updates += unlinked);
+
+    nodes[column].down = down;
+    nodes[down].up = column;
+    --nodes[column].top;
+
+    // Only active columns are in the bitsets
+    if (u->bounds[column].bound != 0 && column <= u->small_columns.limit) {
+	small_columns_resize(
+	    &u->small_columns, column, nodes[column].top + 1,
+	    nodes[column].top);
+    }
+}
+
+/* Put back the subsets of `column` tweaked out since `first` */
+void untweak(struct dlx_universe *u, uint32_t column, uint32_t first) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t next = nodes[column].down, up = column;
+    int hidden = u->bounds[column].bound != 0;
+    uint64_t relinked = 0;
+    int32_t size = 0;
+
+    nodes[column].down = first;
+
+    for (uint32_t it = first; it != next; it = nodes[it].down) {
+	nodes[it].up = up;
+	up = it;
+	++size;
+
+	if (hidden) {
+	    relinked += unhide(u, it);
+	}
+    }
+
+    nodes[next].up = up;
+    nodes[column].top += size;
+
+    if (hidden && column <= u->small_columns.limit) {
+	small_columns_resize(
+	    &u->small_columns, column, nodes[column].top - size,
+	    nodes[column].top);
+    }
+
+    STAT(u, stats->updates += relinked);
+
+    if (!hidden) {
+	uncover(u, column);
+    }
+}
+
+/* Take `column` out of the active ones for its last branch */
+void deactivate_column(struct dlx_universe *u, uint32_t column) {
+    struct dlx_column *columns = u->columns;
+
+    columns[columns[column].left].right = columns[column].right;
+    columns[columns[column].right].left = columns[column].left;
+
+    if (column <= u->small_columns.limit) {
+	small_columns_erase(&u->small_columns, column, u->nodes[column].top);
+    }
+}
+
+/* Put back `column` once its last branch is done, unless it is covered */
+void reactivate_column(struct dlx_universe *u, uint32_t column) {
+    struct dlx_column *columns = u->columns;
+
+    columns[columns[column].left].right = column;
+    columns[columns[column].right].left = column;
+
+    // Covered columns are put back by uncover
+    if (u->bounds[column].bound != 0 && column <= u->small_columns.limit) {
+	small_columns_insert(&u->small_columns, column, u->nodes[column].top);
+    }
+}
+
+/* Undo the choice of a column at a level, once all its branches are done */
+void restore_column(struct dlx_universe *u, uint32_t column, uint32_t first) {
+    struct dlx_bounds *bounds = u->bounds + column;
+
+    if (bounds->bound == 0 && bounds->slack == 0) {
+	uncover(u, column);
+    } else {
+	untweak(u, column, first);
+    }
+
+    ++bounds->bound;
+}
+
+/* Cover the columns of `node`'s subset other than its own */
+void choose_subset(struct dlx_universe *u, uint32_t node) {
+    struct dlx_node *nodes = u->nodes;
+
+    FOREACH(j, nodes, node, node_right) {
+	uint32_t column = (uint32_t)nodes[j].top;
+
+	if (column > u->primary_columns_size) {
+	    commit(u, j);
+	} else if (--u->bounds[column].bound == 0) {
+	    cover(u, column);
+	}
+    }
+}
+
+void unchoose_subset(struct dlx_universe *u, uint32_t node) {
+    struct dlx_node *nodes = u->nodes;
+
+    FOREACH(j, nodes, node, node_left) {
+	uint32_t column = (uint32_t)nodes[j].top;
+
+	if (column > u->primary_columns_size) {
+	    uncommit(u, j);
+	} else if (u->bounds[column].bound++ == 0) {
+	    uncover(u, column);
+	}
+    }
+}
+
+/*
+ * Column with the fewest branches, the subsets left in it plus one for the
+ * last branch, minus the subsets it still needs. Ties go to the column with
+ * the least slack and then to the longest one. Returns 0 if some column can
+ * no longer get the subsets it needs.
+ */
+uint32_t choose_column_multiplicities(struct dlx_universe *u) {
+    uint32_t column = 0;
+    int32_t best = INT32_MAX, best_slack = 0, best_size = 0;
+
+    for (uint32_t it = u->columns[0].right; it != 0;
+	 it = u->columns[it].right) {
+	struct dlx_bounds bounds = u->bounds[it];
+	int32_t slack =
+	    bounds.slack < bounds.bound ? bounds.slack : bounds.bound;
+	int32_t size = u->nodes[it].top;
+	int32_t branches = size + 1 + slack - bounds.bound;
+
+	if (branches < best ||
+	    (branches == best &&
+	     (slack < best_slack ||
+	      (slack == best_slack && size > best_size)))) {
+	    column = it;
+	    best = branches;
+	    best_slack = slack;
+	    best_size = size;
+	}
+    }
+
+    return best > 0 ? column : 0;
+}
+
+/* The solution without the column headers of the last branches */
+void solution_iterator_init(struct dlx_universe *u) {
+    size_t size = 0;
+
+    for (size_t l = 0; l < u->solution_stack_size; ++l) {
+	if (u->solution_stack[l] >= u->columns_size) {
+	    u->solution_subsets[size++] = u->solution_stack[l];
+	}
+    }
+
+    dlx_solution_iterator_init(&u->solution_iterator, u);
+    u->solution_iterator.solutions = u->solution_subsets;
+    u->solution_iterator.end = size;
+}
+
+/*
+ * Like search_progress, with the branches of a level being the subsets
+ * tweaked out of its column, the ones left and the last branch.
+ */
+double search_progress_multiplicities(
+    const struct dlx_universe *u, size_t level) {
+    const struct dlx_node *nodes = u->nodes;
+    double fraction = 0, weight = 1;
+
+    for (size_t l = u->search_base; l < level; ++l) {
+	uint32_t node = u->solution_stack[l];
+	uint32_t column =
+	    node < u->columns_size ? node : (uint32_t)nodes[node].top;
+	uint32_t position = 0, branches = 0;
+
+	for (uint32_t it = u->first_tweaks[l]; it != column;
+	     it = nodes[it].down) {
+	    if (it == node) {
+		position = branches;
+	    }
+
+	    ++branches;
+	}
+
+	if (node == column) {
+	    position = branches++;
+	}
+
+	weight /= branches;
+	fraction += position * weight;
+    }
+
+    return fraction + weight / 2;
+}
+
+void search_unwind_multiplicities(struct dlx_universe *u) {
+    uint32_t *x = u->solution_stack;
+    size_t level = u->solution_stack_size;
+
+    // The search only stops entering or leaving a level, with nothing done
+    // at the current one
+    while (level > u->search_base) {
+	uint32_t column;
+
+	--level;
+
+	if (x[level] < u->columns_size) {
+	    column = x[level];
+	    reactivate_column(u, column);
+	} else {
+	    column = (uint32_t)u->nodes[x[level]].top;
+	    unchoose_subset(u, x[level]);
+	}
+
+	restore_column(u, column, u->first_tweaks[level]);
+    }
+
+    u->solution_stack_size = u->search_base;
+    u->search_state = SEARCH_IDLE;
+}
+
+/* Algorithm M with the same states, modes and stops as search_loop */
+static inline int search_loop_multiplicities(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode) {
+    if (universe->desired_number_of_solutions &&
+	universe->number_of_solutions_found ==
+	    universe->desired_number_of_solutions) {
+	dlx_universe_search_abort(universe);
+	return DLX_SEARCH_FINISHED;
+    }
+
+    struct dlx_node *nodes = universe->nodes;
+    struct dlx_column *columns = universe->columns;
+    struct dlx_bounds *bounds = universe->bounds;
+    uint32_t *x = universe->solution_stack;
+    uint32_t *first = universe->first_tweaks;
+    size_t level = universe->solution_stack_size;
+    uint32_t column = universe->search_column;
+    enum search_state state = universe->search_state;
+    unsigned long nodes_visited = 0;
+
+    for (;;) {
+	switch (state) {
+	case SEARCH_ENTER:
+	    if (max_nodes && nodes_visited == max_nodes) {
+		universe->solution_stack_size = level;
+		universe->search_column = column;
+		universe->search_state = state;
+		return DLX_SEARCH_SUSPENDED;
+	    }
+
+	    if (universe->search_nodes == universe->next_check &&
+		search_check(universe, level)) {
+		universe->solution_stack_size = level;
+		universe->search_state = state;
+		search_unwind(universe);
+		return DLX_SEARCH_ABORTED;
+	    }
+
+	    ++nodes_visited;
+	    ++universe->search_nodes;
+	    STAT(universe, stats_node(stats, level));
+
+	    if (columns[0].right == 0) {
+		++universe->number_of_solutions_found;
+		STAT(universe, ++stats->solutions);
+		state = SEARCH_LEAVE;
+
+		if (mode == SEARCH_COUNT) {
+		    break;
+		}
+
+		universe->solution_stack_size = level;
+		solution_iterator_init(universe);
+
+		if (mode == SEARCH_PULL) {
+		    universe->search_state = SEARCH_LEAVE;
+		    return SEARCH_SOLUTION;
+		}
+
+		search_report(universe);
+
+		if (universe->desired_number_of_solutions &&
+		    universe->number_of_solutions_found ==
+			universe->desired_number_of_solutions) {
+		    universe->search_state = SEARCH_LEAVE;
+		    search_unwind(universe);
+		    return DLX_SEARCH_FINISHED;
+		}
+
+		break;
+	    }
+
+	    column = choose_column_multiplicities(universe);
+
+	    if (column == 0) {
+		state = SEARCH_LEAVE;
+		break;
+	    }
+
+	    x[level] = first[level] = nodes[column].down;
+
+	    if (--bounds[column].bound == 0) {
+		cover(universe, column);
+	    }
+
+	    state = SEARCH_TRY;
+	    break;
+
+	case SEARCH_TRY:
+	    if (bounds[column].bound == 0 && bounds[column].slack == 0) {
+		if (x[level] == column) {
+		    restore_column(universe, column, first[level]);
+		    state = SEARCH_LEAVE;
+		    break;
+		}
+	    } else if (
+		nodes[column].top <=
+		bounds[column].bound - bounds[column].slack) {
+		// Too few subsets left for the column's lower bound
+		restore_column(universe, column, first[level]);
+		state = SEARCH_LEAVE;
+		break;
+	    } else if (x[level] != column) {
+		tweak(universe, x[level], column);
+	    } else if (bounds[column].bound != 0) {
+		deactivate_column(universe, column);
+	    }
+
+	    if (x[level] != column) {
+		choose_subset(universe, x[level]);
+	    }
+
+	    ++level;
+	    state = SEARCH_ENTER;
+	    break;
+
+	case SEARCH_RETRY:
+	    unchoose_subset(universe, x[level]);
+
+	    column = (uint32_t)nodes[x[level]].top;
+	    x[level] = nodes[x[level]].down;
+	    state = SEARCH_TRY;
+	    break;
+
+	case SEARCH_LEAVE:
+	    if (level == universe->search_base) {
+		universe->solution_stack_size = level;
+		universe->search_state = SEARCH_IDLE;
+		return DLX_SEARCH_FINISHED;
+	    }
+
+	    --level;
+
+	    if (x[level] >= universe->columns_size) {
+		state = SEARCH_RETRY;
+		break;
+	    }
+
+	    // The last branch of the level is done, reactivate its column
+	    column = x[level];
+	    reactivate_column(universe, column);
+	    restore_column(universe, column, first[level]);
+	    break;
+
+	case SEARCH_IDLE:
+	    return DLX_SEARCH_FINISHED;
+	}
+    }
+}
+
+int search_run_multiplicities(
+    struct dlx_universe *universe, unsigned long max_nodes,
+    enum search_mode mode) {
+    switch (mode) {
+    case SEARCH_PULL:
+	return search_loop_multiplicities(universe, max_nodes, SEARCH_PULL);
+    case SEARCH_COUNT:
+	return search_loop_multiplicities(universe, max_nodes, SEARCH_COUNT);
+    default:
+	return search_loop_multiplicities(universe, max_nodes, SEARCH_HANDLER);
+    }
+}
+
+/* Grow the solution stack and the arrays indexed by level */
+int reserve_levels(struct dlx_universe *u, size_t levels) {
+    if (u->first_tweaks != NULL && levels <= u->solution_stack_capacity) {
+	return 0;
+    }
+
+    if (levels < u->solution_stack_capacity) {
+	levels = u->solution_stack_capacity;
+    }
+
+    uint32_t *solution_stack =
+	realloc(u->solution_stack, sizeof(uint32_t) * levels);
+
+    if (solution_stack == NULL) {
+	return -1;
+    }
+
+    u->solution_stack = solution_stack;
+
+    uint32_t *first_tweaks =
+	realloc(u->first_tweaks, sizeof(uint32_t) * levels);
+
+    if (first_tweaks == NULL) {
+	return -1;
+    }
+
+    u->first_tweaks = first_tweaks;
+
+    uint32_t *solution_subsets =
+	realloc(u->solution_subsets, sizeof(uint32_t) * levels);
+
+    if (solution_subsets == NULL) {
+	return -1;
+    }
+
+    u->solution_subsets = solution_subsets;
+    u->solution_stack_capacity = levels;
+
+    return 0;
+}
+
+// dlx_universe methods
+
+int dlx_universe_set_bounds(
+    struct dlx_universe *universe, size_t column, unsigned int lo,
+    unsigned int hi) {
+    if (column >= universe->primary_columns_size || hi == 0 || lo > hi ||
+	hi > INT32_MAX || universe->search_state != SEARCH_IDLE ||
+	universe->reduce_log_size || universe->symmetries) {
+	return -1;
+    }
+
+    ++column;
+
+    // Every level either chooses a subset, taking one from a column's upper
+    // bound, or deactivates a column
+    size_t bounds_total =
+	(universe->bounds ? universe->bounds_total -
+				(size_t)universe->bounds[column].bound
+			  : universe->primary_columns_size - 1) +
+	hi;
+
+    if (reserve_levels(
+	    universe, bounds_total + universe->primary_columns_size + 1)) {
+	return -1;
+    }
+
+    if (universe->bounds == NULL) {
+	universe->bounds =
+	    malloc(sizeof(struct dlx_bounds) * universe->columns_size);
+
+	if (universe->bounds == NULL) {
+	    return -1;
+	}
+
+	for (size_t i = 0; i < universe->columns_size; ++i) {
+	    universe->bounds[i].bound = 1;
+	    universe->bounds[i].slack = 0;
+	}
+    }
+
+    universe->bounds[column].bound = (int32_t)hi;
+    universe->bounds[column].slack = (int32_t)(hi - lo);
+    universe->bounds_total = bounds_total;
+
+    return 0;
+}
@@ -0,0 +1,634 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx_internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Parallel search: the calling thread expands the search tree up to the
+ * split depth while a pool of threads is searching already, every open node
+ * becoming a task holding the subsets chosen on its path. Every thread owns a
+ * deque, which the tasks are dealt to in turn as soon as they are found:
+ * threads take the last task of their own deque, steal the first one of
+ * another when theirs is empty, and replay it on their own copy of the
+ * universe, the calling thread joining them once the tree is expanded.
+ *
+ * Threads search their task a few nodes at a time and, when others are idle
+ * with no task left to steal, split it: the subsets not yet tried on the
+ * shallowest level of their search that has some become tasks of their own
+ * deque, so a single large subtree still keeps every thread busy. Counting
+ * threads keep a tally of their own, added up when they are all done.
+ */
+
+// Nodes searched between two looks at the idle threads
+#define SPLIT_INTERVAL 256
+
+/* Subsets chosen on the path to a node of the search tree */
+struct task {
+    uint32_t *prefix;
+    size_t size;
+};
+
+/* Tasks taken from the back by their owner and stolen from the front */
+struct task_deque {
+    struct task *tasks;
+    size_t first;
+    size_t size;
+    size_t capacity;
+    pthread_mutex_t lock;
+};
+
+struct worker {
+    struct parallel_search *search;
+    struct dlx_universe *universe;
+    struct task_deque deque;
+    struct dlx_stats stats;
+    uint64_t number_of_solutions_found;
+    pthread_t thread;
+};
+
+struct parallel_search {
+    struct dlx_universe *universe;
+    enum search_mode mode;
+    size_t base;
+    struct worker *workers;
+    unsigned int number_of_workers;
+    unsigned int next_worker;
+
+    // Idle threads wait under the lock for tasks to steal, until the tree is
+    // expanded and all the `running` threads are idle with none pending.
+    // Tasks are counted before they can be taken, which keeps the count
+    // from wrapping
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    unsigned int running;
+    int expanded;
+    atomic_uint idle;
+    atomic_size_t tasks_pending;
+
+    _Atomic uint64_t number_of_solutions_found;
+    atomic_int stop;
+    atomic_int aborted;
+};
+
+// task_deque methods
+
+/* Append all of `tasks`, or none of them if memory ran out */
+int task_deque_append(
+    struct task_deque *d, const struct task *tasks, size_t count) {
+    int error = 0;
+
+    pthread_mutex_lock(&d->lock);
+
+    if (d->first + d->size + count > d->capacity && d->first) {
+	memmove(d->tasks, d->tasks + d->first, sizeof(struct task) * d->size);
+	d->first = 0;
+    }
+
+    if (d->size + count > d->capacity) {
+	size_t capacity = d->capacity ? d->capacity : 16;
+
+	while (capacity < d->size + count) {
+	    capacity *= 2;
+	}
+
+	struct task *grown = realloc(d->tasks, sizeof(struct task) * capacity);
+
+	if (grown) {
+	    d->tasks = grown;
+	    d->capacity = capacity;
+	} else {
+	    error = -1;
+	}
+    }
+
+    if (!error) {
+	memcpy(
+	    d->tasks + d->first + d->size, tasks, sizeof(struct task) * count);
+	d->size += count;
+    }
+
+    pthread_mutex_unlock(&d->lock);
+
+    return error;
+}
+
+/* Take the last task, or the first one to steal it. Returns 0 if empty */
+int task_deque_take(struct task_deque *d, struct task *task, int steal) {
+    int found = 0;
+
+    pthread_mutex_lock(&d->lock);
+
+    if (d->size) {
+	*task = d->tasks[steal ? d->first++ : d->first + d->size - 1];
+	--d->size;
+	found = 1;
+    }
+
+    pthread_mutex_unlock(&d->lock);
+
+    return found;
+}
+
+/* Tasks left when the search stopped early are dropped */
+void task_deque_free(struct task_deque *d) {
+    for (size_t i = d->first; i < d->first + d->size; ++i) {
+	free(d->tasks[i].prefix);
+    }
+
+    free(d->tasks);
+    pthread_mutex_destroy(&d->lock);
+}
+
+// parallel_search methods
+
+/* Have every thread stop, waking the idle ones */
+void parallel_stop(struct parallel_search *p) {
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->stop, 1);
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Append tasks to a worker's deque and wake the idle threads to steal them */
+int parallel_publish(
+    struct parallel_search *p, struct worker *w, const struct task *tasks,
+    size_t count) {
+    pthread_mutex_lock(&p->lock);
+    atomic_fetch_add(&p->tasks_pending, count);
+
+    int error = task_deque_append(&w->deque, tasks, count);
+
+    if (error) {
+	atomic_fetch_sub(&p->tasks_pending, count);
+    } else {
+	pthread_cond_broadcast(&p->work);
+    }
+
+    pthread_mutex_unlock(&p->lock);
+
+    return error;
+}
+
+/* Returns 1 when the desired number of solutions has been reached */
+int report_solution(
+    struct parallel_search *p, struct dlx_universe *u,
+    struct dlx_solution_iterator *iter) {
+    unsigned int desired = u->desired_number_of_solutions;
+    uint64_t found = atomic_fetch_add(&p->number_of_solutions_found, 1);
+
+    if (desired && found >= desired) {
+	parallel_stop(p);
+	return 1;
+    }
+
+    (*u->solution_handler)(iter);
+
+    if (desired && found + 1 == desired) {
+	parallel_stop(p);
+	return 1;
+    }
+
+    return 0;
+}
+
+void stats_merge(struct dlx_stats *stats, const struct dlx_stats *worker) {
+    stats->nodes += worker->nodes;
+    stats->updates += worker->updates;
+    stats->solutions += worker->solutions;
+
+    if (worker->max_depth > stats->max_depth) {
+	stats->max_depth = worker->max_depth;
+    }
+
+    for (size_t i = 0; i < worker->profile_size; ++i) {
+	stats->profile[i] += worker->profile[i];
+    }
+}
+
+/* Have a copy of the universe count on its own, to be merged at the end */
+void stats_attach(struct dlx_universe *u, struct dlx_stats *stats) {
+    if (u->stats == NULL) {
+	return;
+    }
+
+    stats->profile_size = u->stats->profile ? u->stats->profile_size : 0;
+    stats->profile = calloc(stats->profile_size, sizeof(uint64_t));
+
+    if (stats->profile == NULL) {
+	stats->profile_size = 0;
+    }
+
+    u->stats = stats;
+}
+
+/* Task of the subsets chosen from `p->base` on, followed by `last` if any */
+int task_init(
+    struct task *task, const struct parallel_search *p,
+    const struct dlx_universe *u, size_t level, const uint32_t *last) {
+    task->size = level - p->base + (last != NULL);
+    task->prefix = malloc(sizeof(uint32_t) * (task->size + 1));
+
+    if (task->prefix == NULL) {
+	return -1;
+    }
+
+    memcpy(
+	task->prefix, u->solution_stack + p->base,
+	sizeof(uint32_t) * (level - p->base));
+
+    if (last) {
+	task->prefix[task->size - 1] = *last;
+    }
+
+    return 0;
+}
+
+int expand(struct parallel_search *p, size_t depth) {
+    struct dlx_universe *u = p->universe;
+    struct dlx_node *nodes = u->nodes;
+
+    if (depth == 0) {
+	struct task task;
+
+	if (task_init(&task, p, u, u->search_base, NULL)) {
+	    return -1;
+	}
+
+	if (parallel_publish(p, p->workers + p->next_worker, &task, 1)) {
+	    free(task.prefix);
+	    return -1;
+	}
+
+	p->next_worker = (p->next_worker + 1) % p->number_of_workers;
+
+	return 0;
+    }
+
+    STAT(u, stats_node(stats, u->search_base));
+
+    if (u->columns[0].right == 0) {
+	if (p->mode == SEARCH_COUNT) {
+	    atomic_fetch_add(&p->number_of_solutions_found, 1);
+	} else {
+	    dlx_solution_iterator_init(&u->solution_iterator, u);
+	    report_solution(p, u, &u->solution_iterator);
+	}
+
+	return 0;
+    }
+
+    uint32_t column = choose_column(u);
+
+    FOREACH(row, nodes, column, node_down) {
+	search_push(u, row);
+	int error = expand(p, depth - 1);
+	search_pop(u);
+
+	if (error) {
+	    return error;
+	}
+
+	if (atomic_load(&p->stop)) {
+	    break;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Take a task from the worker's deque or steal one, waiting while the others
+ * may still make some. Returns 0 when the search is over.
+ */
+int task_next(struct worker *w, struct task *task) {
+    struct parallel_search *p = w->search;
+    unsigned int n = p->number_of_workers;
+    unsigned int self = (unsigned int)(w - p->workers);
+
+    while (!atomic_load(&p->stop)) {
+	for (unsigned int i = 0; i < n; ++i) {
+	    struct worker *victim = p->workers + (self + i) % n;
+
+	    if (task_deque_take(&victim->deque, task, i != 0)) {
+		atomic_fetch_sub(&p->tasks_pending, 1);
+		return 1;
+	    }
+	}
+
+	pthread_mutex_lock(&p->lock);
+	atomic_fetch_add(&p->idle, 1);
+
+	while (!atomic_load(&p->stop) && atomic_load(&p->tasks_pending) == 0 &&
+	       !(p->expanded && atomic_load(&p->idle) == p->running)) {
+	    pthread_cond_wait(&p->work, &p->lock);
+	}
+
+	if (atomic_load(&p->tasks_pending) == 0) {
+	    // Every thread is idle, or the search stopped
+	    pthread_cond_broadcast(&p->work);
+	    pthread_mutex_unlock(&p->lock);
+	    return 0;
+	}
+
+	atomic_fetch_sub(&p->idle, 1);
+	pthread_mutex_unlock(&p->lock);
+    }
+
+    return 0;
+}
+
+/*
+ * Hand the subsets not yet tried on the shallowest level that has some to the
+ * idle threads, the search going on below that level. The search is unwound
+ * and its subsets pushed again, as the rows left on a level only show once
+ * those chosen below it are taken back.
+ */
+void task_split(struct worker *w) {
+    struct parallel_search *p = w->search;
+    struct dlx_universe *u = w->universe;
+    struct dlx_node *nodes = u->nodes;
+    struct dlx_stats *stats = u->stats;
+    size_t first = u->search_base;
+    size_t level = u->solution_stack_size;
+    size_t split = first;
+    int found = 0;
+
+    if (level == first) {
+	return;
+    }
+
+    // Moving the links again is not part of the search
+    u->stats = NULL;
+    search_unwind(u);
+
+    for (size_t l = first; l < level; ++l) {
+	uint32_t row = u->solution_stack[l];
+	uint32_t column = (uint32_t)nodes[row].top;
+	size_t count = 0;
+
+	for (uint32_t i = nodes[row].down; !found && i != column;
+	     i = nodes[i].down) {
+	    ++count;
+	}
+
+	if (count) {
+	    struct task *tasks = malloc(sizeof(struct task) * count);
+	    size_t built = 0;
+
+	    for (uint32_t i = nodes[row].down; tasks && built < count;
+		 i = nodes[i].down) {
+		if (task_init(tasks + built, p, u, l, &i)) {
+		    break;
+		}
+
+		++built;
+	    }
+
+	    if (built == count && parallel_publish(p, w, tasks, count) == 0) {
+		found = 1;
+		split = l + 1;
+	    } else {
+		while (built) {
+		    free(tasks[--built].prefix);
+		}
+	    }
+
+	    free(tasks);
+	}
+
+	search_push(u, row);
+    }
+
+    u->search_base = split;
+    u->solution_stack_size = level;
+    u->search_state = SEARCH_ENTER;
+    u->stats = stats;
+}
+
+/* Search the task a few nodes at a time, splitting it for idle threads */
+int task_search(struct worker *w) {
+    struct parallel_search *p = w->search;
+    struct dlx_universe *u = w->universe;
+    int status;
+
+    for (;;) {
+	status = search_run(u, SPLIT_INTERVAL, p->mode);
+
+	if (status == SEARCH_SOLUTION) {
+	    if (report_solution(p, p->universe, &u->solution_iterator)) {
+		return status;
+	    }
+	} else if (status != DLX_SEARCH_SUSPENDED) {
+	    return status;
+	} else if (atomic_load(&p->stop)) {
+	    return status;
+	} else if (
+	    atomic_load(&p->idle) && atomic_load(&p->tasks_pending) == 0) {
+	    task_split(w);
+	}
+    }
+}
+
+void *worker_run(void *arg) {
+    struct worker *w = arg;
+    struct parallel_search *p = w->search;
+    struct dlx_universe *u = w->universe;
+    struct task task;
+
+    while (task_next(w, &task)) {
+	for (size_t i = 0; i < task.size; ++i) {
+	    search_push(u, task.prefix[i]);
+	}
+
+	free(task.prefix);
+	dlx_universe_search_begin(u, DLX_ALL);
+
+	// Only the time budget applies, to the search as a whole
+	u->deadline = p->universe->deadline;
+	search_schedule_check(u);
+
+	int status = task_search(w);
+
+	if (p->mode == SEARCH_COUNT) {
+	    w->number_of_solutions_found += u->number_of_solutions_found;
+	}
+
+	if (status == DLX_SEARCH_ABORTED) {
+	    atomic_store(&p->aborted, 1);
+	    parallel_stop(p);
+	}
+
+	// Splits moved the base of the search up
+	dlx_universe_search_abort(u);
+
+	while (u->search_base > p->base) {
+	    search_pop(u);
+	}
+    }
+
+    return NULL;
+}
+
+/*
+ * Search or count on threads of their own while the calling thread expands
+ * the tree, then on the calling thread as well. Returns -1 if the search
+ * could not be completed.
+ */
+int parallel_run(
+    struct dlx_universe *universe, enum search_mode mode,
+    unsigned int number_of_threads, unsigned int split_depth) {
+    struct parallel_search p = {
+	.universe = universe, .mode = mode, .base = universe->search_base};
+    int result = 0;
+
+    if (number_of_threads == 0) {
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	number_of_threads = online > 0 ? (unsigned int)online : 1;
+    }
+
+    p.workers = calloc(number_of_threads, sizeof(struct worker));
+
+    if (p.workers == NULL) {
+	return -1;
+    }
+
+    p.number_of_workers = number_of_threads;
+    atomic_init(&p.idle, 0);
+    atomic_init(&p.tasks_pending, 0);
+    atomic_init(&p.number_of_solutions_found, 0);
+    atomic_init(&p.stop, 0);
+    atomic_init(&p.aborted, 0);
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.work, NULL);
+
+    // The copies are made before the expansion starts moving the links
+    for (unsigned int i = 0; i < number_of_threads; ++i) {
+	struct worker *w = p.workers + i;
+	struct dlx_universe *u = universe_clone(universe);
+
+	w->search = &p;
+	w->universe = u;
+	pthread_mutex_init(&w->deque.lock, NULL);
+
+	if (u) {
+	    stats_attach(u, &w->stats);
+	    u->max_nodes = 0;
+	    u->progress = NULL;
+
+	    // Random choices differ from one worker to the next
+	    u->random_state += i;
+	}
+    }
+
+    // The calling thread works too, so the search completes even if no
+    // thread can be created
+    unsigned int started = 1;
+
+    pthread_mutex_lock(&p.lock);
+
+    while (started < number_of_threads && p.workers[started].universe &&
+	   pthread_create(
+	       &p.workers[started].thread, NULL, &worker_run,
+	       p.workers + started) == 0) {
+	++started;
+    }
+
+    p.running = started - (p.workers[0].universe == NULL);
+    pthread_mutex_unlock(&p.lock);
+
+    if (expand(&p, split_depth)) {
+	result = -1;
+	parallel_stop(&p);
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.expanded = 1;
+    pthread_cond_broadcast(&p.work);
+    pthread_mutex_unlock(&p.lock);
+
+    if (p.workers[0].universe) {
+	worker_run(p.workers);
+    }
+
+    for (unsigned int i = 1; i < started; ++i) {
+	pthread_join(p.workers[i].thread, NULL);
+    }
+
+    // Tasks are left over when no thread could take them
+    if (atomic_load(&p.aborted) ||
+	(!atomic_load(&p.stop) && atomic_load(&p.tasks_pending))) {
+	result = -1;
+    }
+
+    uint64_t found = atomic_load(&p.number_of_solutions_found);
+
+    for (unsigned int i = 0; i < number_of_threads; ++i) {
+	struct worker *w = p.workers + i;
+
+	if (w->universe && w->universe->stats) {
+	    stats_merge(universe->stats, &w->stats);
+	}
+
+	found += w->number_of_solutions_found;
+	free(w->stats.profile);
+	dlx_universe_free(w->universe);
+	task_deque_free(&w->deque);
+    }
+
+    universe->number_of_solutions_found = found;
+    universe->search_status = result ? DLX_SEARCH_ABORTED : DLX_SEARCH_FINISHED;
+
+    pthread_cond_destroy(&p.work);
+    pthread_mutex_destroy(&p.lock);
+    free(p.workers);
+
+    return result;
+}
+
+// dlx_universe methods
+
+int dlx_universe_search_parallel(
+    struct dlx_universe *universe, unsigned int desired_number_of_solutions,
+    unsigned int number_of_threads, unsigned int split_depth) {
+    // Algorithm M's search state can't be split in prefixes, and orbits of
+    // solutions are only reported by the search on the links
+    if (universe->bounds || universe->symmetries) {
+	return dlx_universe_search(universe, desired_number_of_solutions) ==
+			   DLX_SEARCH_FINISHED
+		   ? 0
+		   : -1;
+    }
+
+    dlx_universe_search_abort(universe);
+    universe->desired_number_of_solutions = desired_number_of_solutions;
+    universe->deadline = seconds_now() + universe->max_seconds;
+
+    int result =
+	parallel_run(universe, SEARCH_PULL, number_of_threads, split_depth);
+
+    if (desired_number_of_solutions &&
+	universe->number_of_solutions_found > desired_number_of_solutions) {
+	universe->number_of_solutions_found = desired_number_of_solutions;
+    }
+
+    return result;
+}
+
+uint64_t dlx_universe_count_parallel(
+    struct dlx_universe *universe, unsigned int number_of_threads,
+    unsigned int split_depth) {
+    if (universe->bounds || universe->symmetries) {
+	return dlx_universe_count(universe);
+    }
+
+    dlx_universe_search_abort(universe);
+    universe->desired_number_of_solutions = DLX_ALL;
+    universe->deadline = seconds_now() + universe->max_seconds;
+
+    parallel_run(universe, SEARCH_COUNT, number_of_threads, split_depth);
+
+    return universe->number_of_solutions_found;
+}
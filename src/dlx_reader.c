@@ -0,0 +1,542 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx_internal.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Reader for the text format of Knuth's DLX programs: lines starting with
+ * '|' are comments, the first other line names the items, primary ones
+ * first and secondary ones after a lone '|', and every following line is an
+ * option listing its items. A secondary item of an option may be given a
+ * color as "item:color", and a primary item may be declared with bounds as
+ * "lo:hi|item" or "hi|item", as in DLX3.
+ *
+ * Lines are read into one buffer and split in place, names are interned in
+ * open addressing hash tables and options are kept in compressed sparse row
+ * form, so nothing is allocated per token.
+ */
+
+/*
+ * Every slot holds the index plus one of the name hashed to it, 0 if free,
+ * and the high bits of its hash, so that probes rarely look at other names
+ */
+struct name_slot {
+    uint32_t name;
+    uint32_t tag;
+};
+
+struct name_table {
+    struct name_slot *slots;
+    size_t capacity;
+
+    // Names are stored one after another, NUL terminated
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+    size_t *offsets;
+    size_t size;
+    size_t offsets_capacity;
+};
+
+struct dlx_reader {
+    FILE *file;
+    char *line;
+    size_t line_capacity;
+    size_t line_number;
+
+    struct name_table items;
+    struct name_table colors;
+    size_t primary_items;
+
+    // Bounds of the items as read, and the last option each appeared in
+    unsigned int *bounds;
+    size_t *stamps;
+
+    size_t *offsets;
+    size_t options_size;
+    size_t offsets_capacity;
+    uint32_t *option_items;
+    uint32_t *option_colors;
+    size_t option_items_size;
+    size_t option_items_capacity;
+
+    char error[128];
+};
+
+/* Grow `*array` of `size` elements to hold at least `needed` of them */
+int reader_grow(void **array, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) {
+	return 0;
+    }
+
+    size_t new_capacity = *capacity ? *capacity : 16;
+
+    while (new_capacity < needed) {
+	new_capacity *= 2;
+    }
+
+    void *new_array = realloc(*array, size * new_capacity);
+
+    if (new_array == NULL) {
+	return -1;
+    }
+
+    *array = new_array;
+    *capacity = new_capacity;
+
+    return 0;
+}
+
+// name_table methods
+
+/* FNV-1a */
+uint64_t name_hash(const char *name, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < length; ++i) {
+	hash = (hash ^ (unsigned char)name[i]) * 0x100000001b3;
+    }
+
+    return hash;
+}
+
+/* Slot of `name`, or of the free one where it would go */
+size_t name_slot(
+    const struct name_table *t, const char *name, size_t length,
+    uint64_t hash) {
+    size_t slot = (size_t)hash & (t->capacity - 1);
+    uint32_t tag = (uint32_t)(hash >> 32);
+
+    for (; t->slots[slot].name; slot = (slot + 1) & (t->capacity - 1)) {
+	if (t->slots[slot].tag != tag) {
+	    continue;
+	}
+
+	const size_t *offsets = t->offsets + t->slots[slot].name - 1;
+
+	if (offsets[1] - offsets[0] == length + 1 &&
+	    memcmp(t->names + offsets[0], name, length) == 0) {
+	    break;
+	}
+    }
+
+    return slot;
+}
+
+/* Index plus one of `name`, or 0 if it is unknown */
+uint32_t name_find(
+    const struct name_table *t, const char *name, size_t length) {
+    if (t->capacity == 0) {
+	return 0;
+    }
+
+    return t->slots[name_slot(t, name, length, name_hash(name, length))].name;
+}
+
+/* Keep the table at most half full */
+int name_rehash(struct name_table *t) {
+    if (2 * (t->size + 1) <= t->capacity) {
+	return 0;
+    }
+
+    size_t capacity = t->capacity ? 2 * t->capacity : 64;
+    struct name_slot *slots = calloc(capacity, sizeof(struct name_slot));
+
+    if (slots == NULL) {
+	return -1;
+    }
+
+    free(t->slots);
+    t->slots = slots;
+    t->capacity = capacity;
+
+    for (uint32_t i = 0; i < t->size; ++i) {
+	const char *name = t->names + t->offsets[i];
+	size_t length = t->offsets[i + 1] - t->offsets[i] - 1;
+	uint64_t hash = name_hash(name, length);
+	size_t slot = name_slot(t, name, length, hash);
+
+	t->slots[slot].name = i + 1;
+	t->slots[slot].tag = (uint32_t)(hash >> 32);
+    }
+
+    return 0;
+}
+
+/* Index plus one of `name`, added if it is unknown, or 0 on error */
+uint32_t name_intern(struct name_table *t, const char *name, size_t length) {
+    uint32_t found = name_find(t, name, length);
+
+    if (found) {
+	return found;
+    }
+
+    if (t->size >= INT32_MAX || name_rehash(t) ||
+	reader_grow(
+	    (void **)&t->names, &t->names_capacity, t->names_size + length + 1,
+	    sizeof(char)) ||
+	reader_grow(
+	    (void **)&t->offsets, &t->offsets_capacity, t->size + 2,
+	    sizeof(size_t))) {
+	return 0;
+    }
+
+    memcpy(t->names + t->names_size, name, length);
+    t->names[t->names_size + length] = '\0';
+    t->offsets[t->size] = t->names_size;
+    t->names_size += length + 1;
+    t->offsets[++t->size] = t->names_size;
+
+    uint64_t hash = name_hash(name, length);
+    size_t slot = name_slot(t, name, length, hash);
+
+    t->slots[slot].name = (uint32_t)t->size;
+    t->slots[slot].tag = (uint32_t)(hash >> 32);
+
+    return (uint32_t)t->size;
+}
+
+void name_table_free(struct name_table *t) {
+    free(t->slots);
+    free(t->names);
+    free(t->offsets);
+}
+
+// dlx_reader methods
+
+/* Returns NULL */
+void *reader_fail(struct dlx_reader *r, const char *message, const char *name) {
+    snprintf(
+	r->error, sizeof(r->error), "line %zu: %s%s%.64s%s", r->line_number,
+	message, name ? " \"" : "", name ? name : "", name ? "\"" : "");
+
+    return NULL;
+}
+
+/* Next line that is no comment, or NULL at the end of the file */
+char *reader_line(struct dlx_reader *r) {
+    while (getline(&r->line, &r->line_capacity, r->file) >= 0) {
+	++r->line_number;
+
+	if (r->line[0] != '|') {
+	    return r->line;
+	}
+    }
+
+    return NULL;
+}
+
+/* Next token from `*cursor`, NUL terminated in place, or NULL */
+char *reader_token(char **cursor, size_t *length) {
+    char *start = *cursor, *end;
+
+    while (isspace((unsigned char)*start)) {
+	++start;
+    }
+
+    if (*start == '\0') {
+	return NULL;
+    }
+
+    for (end = start; *end && !isspace((unsigned char)*end); ++end) {
+    }
+
+    *length = (size_t)(end - start);
+    *cursor = *end ? end + 1 : end;
+    *end = '\0';
+
+    return start;
+}
+
+/* Bounds before the '|' of a primary item, returns -1 if invalid */
+int reader_bounds(const char *token, const char *bar, unsigned int *bounds) {
+    char *end;
+    unsigned long lo, hi;
+
+    if (!isdigit((unsigned char)*token)) {
+	return -1;
+    }
+
+    lo = hi = strtoul(token, &end, 10);
+
+    if (*end == ':' && isdigit((unsigned char)end[1])) {
+	hi = strtoul(end + 1, &end, 10);
+    }
+
+    if (end != bar || hi == 0 || lo > hi || hi > INT32_MAX) {
+	return -1;
+    }
+
+    bounds[0] = (unsigned int)lo;
+    bounds[1] = (unsigned int)hi;
+
+    return 0;
+}
+
+/* Read the line of items, returns -1 on error */
+int reader_items(struct dlx_reader *r) {
+    char *cursor = reader_line(r), *token;
+    size_t length, capacity = 0;
+    int secondary = 0;
+
+    if (cursor == NULL) {
+	reader_fail(r, "no items", NULL);
+	return -1;
+    }
+
+    while ((token = reader_token(&cursor, &length))) {
+	if (strcmp(token, "|") == 0) {
+	    if (secondary) {
+		reader_fail(r, "second separator", NULL);
+		return -1;
+	    }
+
+	    secondary = 1;
+	    r->primary_items = r->items.size;
+	    continue;
+	}
+
+	unsigned int bounds[2] = {1, 1};
+	char *bar = strchr(token, '|');
+
+	if (bar) {
+	    if (secondary || reader_bounds(token, bar, bounds)) {
+		reader_fail(r, "invalid bounds", token);
+		return -1;
+	    }
+
+	    length -= (size_t)(bar + 1 - token);
+	    token = bar + 1;
+	}
+
+	if (length == 0 || strchr(token, ':') || strchr(token, '|')) {
+	    reader_fail(r, "invalid item name", token);
+	    return -1;
+	}
+
+	if (name_find(&r->items, token, length)) {
+	    reader_fail(r, "duplicate item", token);
+	    return -1;
+	}
+
+	if (name_intern(&r->items, token, length) == 0 ||
+	    reader_grow(
+		(void **)&r->bounds, &capacity, 2 * r->items.size,
+		sizeof(unsigned int))) {
+	    reader_fail(r, "out of memory", NULL);
+	    return -1;
+	}
+
+	r->bounds[2 * r->items.size - 2] = bounds[0];
+	r->bounds[2 * r->items.size - 1] = bounds[1];
+    }
+
+    if (!secondary) {
+	r->primary_items = r->items.size;
+    }
+
+    if (r->primary_items == 0) {
+	reader_fail(r, "no primary items", NULL);
+	return -1;
+    }
+
+    return 0;
+}
+
+/* Parse the option on `cursor` at the end of the options, -1 on error */
+int reader_option(struct dlx_reader *r, char *cursor) {
+    size_t first = r->option_items_size, length;
+    char *token;
+
+    while ((token = reader_token(&cursor, &length))) {
+	char *colon = strchr(token, ':');
+	size_t name_length = colon ? (size_t)(colon - token) : length;
+	uint32_t item = name_find(&r->items, token, name_length);
+	uint32_t color = 0;
+
+	if (colon) {
+	    *colon = '\0';
+	}
+
+	if (item == 0) {
+	    reader_fail(r, "unknown item", token);
+	    return -1;
+	}
+
+	if (r->stamps[item - 1] == r->options_size + 1) {
+	    reader_fail(r, "repeated item", token);
+	    return -1;
+	}
+
+	r->stamps[item - 1] = r->options_size + 1;
+
+	if (colon) {
+	    if (item <= r->primary_items || colon[1] == '\0') {
+		reader_fail(r, "invalid color of item", token);
+		return -1;
+	    }
+
+	    color = name_intern(
+		&r->colors, colon + 1, length - name_length - 1);
+	}
+
+	// Items and colors grow alike from the capacity they share, which is
+	// only updated once both have grown
+	size_t items_capacity = r->option_items_capacity;
+	size_t colors_capacity = r->option_items_capacity;
+
+	if ((colon && color == 0) ||
+	    reader_grow(
+		(void **)&r->option_items, &items_capacity,
+		r->option_items_size + 1, sizeof(uint32_t)) ||
+	    reader_grow(
+		(void **)&r->option_colors, &colors_capacity,
+		r->option_items_size + 1, sizeof(uint32_t))) {
+	    reader_fail(r, "out of memory", NULL);
+	    return -1;
+	}
+
+	r->option_items_capacity = items_capacity;
+
+	r->option_items[r->option_items_size] = item - 1;
+	r->option_colors[r->option_items_size++] = color;
+    }
+
+    if (r->option_items_size == first) {
+	return 0;
+    }
+
+    if (reader_grow(
+	    (void **)&r->offsets, &r->offsets_capacity, r->options_size + 2,
+	    sizeof(size_t))) {
+	reader_fail(r, "out of memory", NULL);
+	return -1;
+    }
+
+    r->offsets[r->options_size] = first;
+    r->offsets[++r->options_size] = r->option_items_size;
+
+    return 0;
+}
+
+struct dlx_reader *dlx_reader_new(FILE *file) {
+    struct dlx_reader *reader = calloc(1, sizeof(struct dlx_reader));
+
+    if (reader != NULL) {
+	reader->file = file;
+    }
+
+    return reader;
+}
+
+struct dlx_universe *dlx_reader_read(
+    struct dlx_reader *reader,
+    void (*solution_handler)(struct dlx_solution_iterator *iter)) {
+    if (reader_items(reader)) {
+	return NULL;
+    }
+
+    size_t items = reader->items.size;
+    struct dlx_universe *universe = dlx_universe_new(
+	solution_handler, reader->primary_items, items - reader->primary_items,
+	0);
+
+    reader->stamps = calloc(items, sizeof(size_t));
+
+    if (universe == NULL || reader->stamps == NULL) {
+	if (universe) {
+	    dlx_universe_free(universe);
+	}
+
+	return reader_fail(reader, "out of memory", NULL);
+    }
+
+    for (size_t i = 0; i < reader->primary_items; ++i) {
+	unsigned int lo = reader->bounds[2 * i], hi = reader->bounds[2 * i + 1];
+
+	if ((lo != 1 || hi != 1) &&
+	    dlx_universe_set_bounds(universe, i, lo, hi)) {
+	    dlx_universe_free(universe);
+	    return reader_fail(
+		reader, "invalid bounds", dlx_reader_item(reader, i));
+	}
+    }
+
+    char *line;
+
+    while ((line = reader_line(reader))) {
+	size_t option = reader->options_size;
+
+	if (reader_option(reader, line)) {
+	    dlx_universe_free(universe);
+	    return NULL;
+	}
+
+	if (reader->options_size == option) {
+	    continue;
+	}
+
+	size_t first = reader->offsets[option];
+
+	// Labels are the options' indices
+	if (dlx_universe_add_subset_array(
+		universe, reader->offsets[option + 1] - first,
+		(void *)(uintptr_t)option, reader->option_items + first,
+		reader->option_colors + first)) {
+	    dlx_universe_free(universe);
+	    return reader_fail(reader, "out of memory", NULL);
+	}
+    }
+
+    if (ferror(reader->file)) {
+	dlx_universe_free(universe);
+	return reader_fail(reader, "read error", NULL);
+    }
+
+    return universe;
+}
+
+const char *dlx_reader_error(struct dlx_reader *reader) {
+    return reader->error[0] ? reader->error : NULL;
+}
+
+size_t dlx_reader_items(struct dlx_reader *reader) {
+    return reader->items.size;
+}
+
+const char *dlx_reader_item(struct dlx_reader *reader, size_t item) {
+    return reader->items.names + reader->items.offsets[item];
+}
+
+const char *dlx_reader_color(struct dlx_reader *reader, uint32_t color) {
+    return reader->colors.names + reader->colors.offsets[color - 1];
+}
+
+size_t dlx_reader_options(struct dlx_reader *reader) {
+    return reader->options_size;
+}
+
+size_t dlx_reader_option(
+    struct dlx_reader *reader, size_t option, const uint32_t **items,
+    const uint32_t **colors) {
+    size_t first = reader->offsets[option];
+
+    *items = reader->option_items + first;
+    *colors = reader->option_colors + first;
+
+    return reader->offsets[option + 1] - first;
+}
+
+void dlx_reader_free(struct dlx_reader *reader) {
+    name_table_free(&reader->items);
+    name_table_free(&reader->colors);
+    free(reader->line);
+    free(reader->bounds);
+    free(reader->stamps);
+    free(reader->offsets);
+    free(reader->option_items);
+    free(reader->option_colors);
+    free(reader);
+}
@@ -0,0 +1,545 @@
+#include "dlx_internal.h"
+
+/*
+ * Changes of the matrix between searches: reductions, none of which loses a
+ * solution, and subsets selected by the caller. The row of a primary column
+ * with a single one is forced and selected rows are chosen alike, pushed
+ * below the search like the prefixes of parallel searches so every solution
+ * still lists them, and the rows no solution can use are unlinked from their
+ * columns, keeping their place in the arena and so their index. Every step
+ * is logged to be rolled back in reverse order.
+ */
+
+// Log entry of a pushed row, the others are the nodes of removed rows
+#define REDUCE_PUSHED 0
+
+struct row_key {
+    uint64_t hash;
+    uint32_t size;
+    uint32_t node;
+};
+
+/* Scratch space of a reduction */
+struct reduce_scratch {
+    struct row_key *rows;
+    uint32_t *stamps;
+    int32_t *values;
+    uint32_t stamp;
+};
+
+int reduce_log(struct dlx_universe *u, uint32_t entry) {
+    if (u->reduce_log_size == u->reduce_log_capacity) {
+	size_t capacity =
+	    u->reduce_log_capacity ? u->reduce_log_capacity * 2 : 64;
+	uint32_t *log = realloc(u->reduce_log, sizeof(uint32_t) * capacity);
+
+	if (log == NULL) {
+	    return -1;
+	}
+
+	u->reduce_log = log;
+	u->reduce_log_capacity = capacity;
+    }
+
+    u->reduce_log[u->reduce_log_size++] = entry;
+
+    return 0;
+}
+
+/* Unlink `node`'s row, `node` first, which must be in an active column */
+void reduce_remove(struct dlx_universe *u, uint32_t node) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t column = (uint32_t)nodes[node].top;
+
+    nodes[nodes[node].up].down = nodes[node].down;
+    nodes[nodes[node].down].up = nodes[node].up;
+    --nodes[column].top;
+
+    if (column <= u->small_columns.limit && nodes[column].top <= 1) {
+	small_columns_resize(
+	    &u->small_columns, column, nodes[column].top + 1,
+	    nodes[column].top);
+    }
+
+    hide(u, node);
+}
+
+/* Undo reduce_remove, `node` last */
+void reduce_restore(struct dlx_universe *u, uint32_t node) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t column = (uint32_t)nodes[node].top;
+
+    unhide(u, node);
+
+    nodes[nodes[node].up].down = node;
+    nodes[nodes[node].down].up = node;
+    ++nodes[column].top;
+
+    if (column <= u->small_columns.limit && nodes[column].top <= 2) {
+	small_columns_resize(
+	    &u->small_columns, column, nodes[column].top - 1,
+	    nodes[column].top);
+    }
+}
+
+int reduce_row(struct dlx_universe *u, uint32_t node) {
+    if (reduce_log(u, node)) {
+	return -1;
+    }
+
+    reduce_remove(u, node);
+
+    return 0;
+}
+
+int reduce_linked(const struct dlx_node *nodes, uint32_t node) {
+    return nodes[nodes[node].down].up == node;
+}
+
+int reduce_primary(const struct dlx_universe *u, uint32_t node) {
+    return (size_t)u->nodes[node].top <= u->primary_columns_size;
+}
+
+/* Whether an active primary column has no row left */
+int reduce_infeasible(const struct dlx_universe *u) {
+    if (u->small_columns.limit) {
+	return u->small_columns.counts[0] != 0;
+    }
+
+    for (uint32_t it = u->columns[0].right; it != 0;
+	 it = u->columns[it].right) {
+	if (u->nodes[it].top == 0) {
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/* Active primary column with a single row, or else 0 */
+uint32_t reduce_single(const struct dlx_universe *u) {
+    if (u->small_columns.limit) {
+	return small_columns_first(&u->small_columns);
+    }
+
+    for (uint32_t it = u->columns[0].right; it != 0;
+	 it = u->columns[it].right) {
+	if (u->nodes[it].top == 1) {
+	    return it;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Gather the rows left, each once from the node in its first primary column,
+ * returning how many
+ */
+size_t reduce_gather(const struct dlx_universe *u, struct row_key *rows) {
+    const struct dlx_node *nodes = u->nodes;
+    size_t size = 0;
+
+    for (uint32_t column = u->columns[0].right; column != 0;
+	 column = u->columns[column].right) {
+	FOREACH(row, nodes, column, node_down) {
+	    int first = 1;
+
+	    FOREACH(it, nodes, row, node_right) {
+		if (reduce_primary(u, it) && nodes[it].top < nodes[row].top) {
+		    first = 0;
+		    break;
+		}
+	    }
+
+	    if (first) {
+		rows[size++].node = row;
+	    }
+	}
+    }
+
+    return size;
+}
+
+/*
+ * First node of subset `subset`, extending the index of the subsets up to
+ * it, or 0 if memory ran out. Each spacer points back to the last node of
+ * the subset after it, which ends before the next spacer.
+ */
+uint32_t subset_first(struct dlx_universe *u, size_t subset) {
+    if (subset >= u->subset_nodes_size) {
+	if (u->subset_nodes_capacity < u->subsets_size) {
+	    uint32_t *subset_nodes =
+		realloc(u->subset_nodes, sizeof(uint32_t) * u->subsets_size);
+
+	    if (subset_nodes == NULL) {
+		return 0;
+	    }
+
+	    u->subset_nodes = subset_nodes;
+	    u->subset_nodes_capacity = u->subsets_size;
+	}
+
+	for (size_t i = u->subset_nodes_size; i <= subset; ++i) {
+	    u->subset_nodes[i] =
+		i ? u->nodes[u->subset_nodes[i - 1] - 1].down + 2
+		  : (uint32_t)u->columns_size + 1;
+	}
+
+	u->subset_nodes_size = subset + 1;
+    }
+
+    return u->subset_nodes[subset];
+}
+
+// Reductions, each returning 1 if it changed anything, 0 if not or -1 if
+// memory ran out
+
+int reduce_forced(struct dlx_universe *u) {
+    uint32_t column;
+    int changed = 0;
+
+    while (!reduce_infeasible(u) && (column = reduce_single(u))) {
+	if (reduce_log(u, REDUCE_PUSHED)) {
+	    return -1;
+	}
+
+	search_push(u, u->nodes[column].down);
+	changed = 1;
+    }
+
+    return changed;
+}
+
+uint64_t reduce_mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+
+    return x ^ (x >> 31);
+}
+
+int row_key_compare(const void *a, const void *b) {
+    const struct row_key *x = a, *y = b;
+
+    if (x->hash != y->hash) {
+	return x->hash < y->hash ? -1 : 1;
+    }
+
+    if (x->size != y->size) {
+	return x->size < y->size ? -1 : 1;
+    }
+
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+/* Whether the rows of `a` and `b`, of the same size, have the same nodes */
+int reduce_same(
+    const struct dlx_universe *u, struct reduce_scratch *s, uint32_t a,
+    uint32_t b) {
+    const struct dlx_node *nodes = u->nodes;
+
+    ++s->stamp;
+
+    FOREACH(it, nodes, a, node_right) {
+	s->stamps[nodes[it].top] = s->stamp;
+	s->values[nodes[it].top] = nodes[it].color;
+    }
+
+    s->stamps[nodes[a].top] = s->stamp;
+    s->values[nodes[a].top] = nodes[a].color;
+
+    if (s->stamps[nodes[b].top] != s->stamp ||
+	s->values[nodes[b].top] != nodes[b].color) {
+	return 0;
+    }
+
+    FOREACH(it, nodes, b, node_right) {
+	if (s->stamps[nodes[it].top] != s->stamp ||
+	    s->values[nodes[it].top] != nodes[it].color) {
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/* Keep the first of identical rows, in the order of the arena */
+int reduce_duplicates(struct dlx_universe *u, struct reduce_scratch *s) {
+    const struct dlx_node *nodes = u->nodes;
+    size_t size = reduce_gather(u, s->rows);
+    int changed = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+	uint32_t row = s->rows[i].node;
+	uint64_t hash =
+	    reduce_mix(((uint64_t)nodes[row].top << 32) ^
+		       (uint32_t)nodes[row].color);
+
+	s->rows[i].size = 1;
+
+	FOREACH(it, nodes, row, node_right) {
+	    hash += reduce_mix(
+		((uint64_t)nodes[it].top << 32) ^ (uint32_t)nodes[it].color);
+	    ++s->rows[i].size;
+	}
+
+	s->rows[i].hash = hash;
+    }
+
+    qsort(s->rows, size, sizeof(struct row_key), &row_key_compare);
+
+    for (size_t first = 0, i = 1; i < size; ++i) {
+	if (s->rows[i].hash != s->rows[first].hash ||
+	    s->rows[i].size != s->rows[first].size) {
+	    first = i;
+	} else if (reduce_same(u, s, s->rows[first].node, s->rows[i].node)) {
+	    if (reduce_row(u, s->rows[i].node)) {
+		return -1;
+	    }
+
+	    changed = 1;
+	}
+    }
+
+    return changed;
+}
+
+/* Whether `node`'s row has a node in `column` */
+int reduce_contains(
+    const struct dlx_node *nodes, uint32_t node, uint32_t column) {
+    if ((uint32_t)nodes[node].top == column) {
+	return 1;
+    }
+
+    FOREACH(it, nodes, node, node_right) {
+	if ((uint32_t)nodes[it].top == column) {
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * When every row of a primary column `a` also covers primary column `b`, the
+ * rows of `b` that don't cover `a` would leave nothing to cover `a`
+ */
+int reduce_dominated(struct dlx_universe *u, struct reduce_scratch *s) {
+    const struct dlx_node *nodes = u->nodes;
+    int changed = 0;
+
+    for (uint32_t a = u->columns[0].right; a != 0; a = u->columns[a].right) {
+	if (nodes[a].top == 0) {
+	    continue;
+	}
+
+	// Count the rows of `a` every other primary column is in, as long as
+	// it is in all of them
+	int32_t rows = 0;
+
+	++s->stamp;
+
+	FOREACH(row, nodes, a, node_down) {
+	    FOREACH(it, nodes, row, node_right) {
+		uint32_t column = (uint32_t)nodes[it].top;
+
+		if (!reduce_primary(u, it)) {
+		    continue;
+		}
+
+		if (rows == 0) {
+		    s->stamps[column] = s->stamp;
+		    s->values[column] = 1;
+		} else if (
+		    s->stamps[column] == s->stamp &&
+		    s->values[column] == rows) {
+		    ++s->values[column];
+		}
+	    }
+
+	    ++rows;
+	}
+
+	FOREACH(it, nodes, nodes[a].down, node_right) {
+	    uint32_t b = (uint32_t)nodes[it].top;
+
+	    if (!reduce_primary(u, it) || s->stamps[b] != s->stamp ||
+		s->values[b] != rows || nodes[b].top == rows) {
+		continue;
+	    }
+
+	    for (uint32_t row = nodes[b].down, next; row != b; row = next) {
+		next = nodes[row].down;
+
+		if (!reduce_contains(nodes, row, a)) {
+		    if (reduce_row(u, row)) {
+			return -1;
+		    }
+
+		    changed = 1;
+		}
+	    }
+	}
+    }
+
+    return changed;
+}
+
+/* Remove the rows whose choice leaves a primary column without rows */
+int reduce_blocking(struct dlx_universe *u, struct reduce_scratch *s) {
+    size_t size = reduce_gather(u, s->rows);
+    int changed = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+	uint32_t row = s->rows[i].node;
+
+	if (!reduce_linked(u->nodes, row)) {
+	    continue;
+	}
+
+	search_push(u, row);
+	int blocked = reduce_infeasible(u);
+	search_pop(u);
+
+	if (blocked) {
+	    if (reduce_row(u, row)) {
+		return -1;
+	    }
+
+	    changed = 1;
+	}
+    }
+
+    return changed;
+}
+
+// dlx_universe methods
+
+int dlx_universe_reduce(struct dlx_universe *universe, int reductions) {
+    if (universe->search_state != SEARCH_IDLE || universe->bounds ||
+	universe->symmetries) {
+	return -1;
+    }
+
+    struct reduce_scratch s = {
+	.rows = malloc(
+	    sizeof(struct row_key) *
+	    (universe->subsets_size ? universe->subsets_size : 1)),
+	.stamps = calloc(universe->columns_size, sizeof(uint32_t)),
+	.values = malloc(sizeof(int32_t) * universe->columns_size),
+	.stamp = 0,
+    };
+
+    // The reductions search like the search does, but are no part of it
+    struct dlx_stats *stats = universe->stats;
+    size_t log_size = universe->reduce_log_size;
+    int changed = s.rows && s.stamps && s.values ? 1 : -1;
+
+    universe->stats = NULL;
+
+    while (changed > 0 && !reduce_infeasible(universe)) {
+	changed = 0;
+
+	// The costlier reductions only run once the cheaper ones are done
+	if (reductions & DLX_REDUCE_FORCED) {
+	    changed = reduce_forced(universe);
+	}
+
+	if (changed == 0 && (reductions & DLX_REDUCE_DUPLICATES)) {
+	    changed = reduce_duplicates(universe, &s);
+	}
+
+	if (changed == 0 && (reductions & DLX_REDUCE_DOMINATED)) {
+	    changed = reduce_dominated(universe, &s);
+	}
+
+	if (changed == 0 && (reductions & DLX_REDUCE_BLOCKING)) {
+	    changed = reduce_blocking(universe, &s);
+	}
+    }
+
+    universe->stats = stats;
+
+    // Cells built before are out of date, and so is the order of the arena
+    if (universe->reduce_log_size != log_size) {
+	rows_reordered(universe);
+    }
+
+    free(s.rows);
+    free(s.stamps);
+    free(s.values);
+
+    return changed < 0 ? -1 : 0;
+}
+
+void dlx_universe_unreduce(struct dlx_universe *universe) {
+    dlx_universe_rollback(universe, 0);
+}
+
+int dlx_universe_select(struct dlx_universe *universe, size_t subset) {
+    if (universe->search_state != SEARCH_IDLE || universe->bounds ||
+	universe->symmetries || subset >= universe->subsets_size) {
+	return -1;
+    }
+
+    uint32_t first = subset_first(universe, subset);
+    const struct dlx_node *nodes = universe->nodes;
+    const struct dlx_column *columns = universe->columns;
+
+    if (first == 0) {
+	return -1;
+    }
+
+    // A row left out by the changes so far has a node unlinked, or a single
+    // one in a covered column
+    uint32_t primary = 0;
+
+    for (uint32_t it = first; nodes[it].top > 0; ++it) {
+	uint32_t column = (uint32_t)nodes[it].top;
+
+	if (!reduce_linked(nodes, it) ||
+	    (reduce_primary(universe, it) &&
+	     columns[columns[column].left].right != column)) {
+	    return -1;
+	}
+
+	if (primary == 0 && reduce_primary(universe, it)) {
+	    primary = it;
+	}
+    }
+
+    // Searches only choose rows from primary columns
+    if (primary == 0 || reduce_log(universe, REDUCE_PUSHED)) {
+	return -1;
+    }
+
+    search_push(universe, primary);
+
+    return 0;
+}
+
+size_t dlx_universe_mark(struct dlx_universe *universe) {
+    return universe->reduce_log_size;
+}
+
+void dlx_universe_rollback(struct dlx_universe *universe, size_t mark) {
+    int restored = 0;
+
+    dlx_universe_search_abort(universe);
+
+    while (universe->reduce_log_size > mark) {
+	uint32_t entry = universe->reduce_log[--universe->reduce_log_size];
+
+	if (entry == REDUCE_PUSHED) {
+	    search_pop(universe);
+	} else {
+	    reduce_restore(universe, entry);
+	    restored = 1;
+	}
+    }
+
+    // Cells built from the reduced matrix are out of date
+    if (restored) {
+	rows_reordered(universe);
+    }
+}
@@ -0,0 +1,103 @@
+#include "dlx_internal.h"
+
+/*
+ * Shards: the open nodes of the search tree some levels down, written as
+ * lines of the subset indices chosen on their path, so that separate
+ * processes, on this machine or others, can each search some of them by
+ * selecting their subsets. Nothing is shared but the file and the matrix.
+ */
+
+/* Write the nodes `depth` levels below, or solutions found sooner */
+int shard_expand(
+    struct dlx_universe *u, size_t base, size_t depth, FILE *file) {
+    const struct dlx_node *nodes = u->nodes;
+
+    if (depth == 0 || u->columns[0].right == 0) {
+	for (size_t l = base; l < u->search_base; ++l) {
+	    fprintf(
+		file, l > base ? " %zu" : "%zu",
+		subset_index(nodes, u->solution_stack[l]));
+	}
+
+	return putc('\n', file) == EOF ? -1 : 0;
+    }
+
+    uint32_t column = choose_column(u);
+
+    FOREACH(row, nodes, column, node_down) {
+	search_push(u, row);
+	int error = shard_expand(u, base, depth - 1, file);
+	search_pop(u);
+
+	if (error) {
+	    return error;
+	}
+    }
+
+    return 0;
+}
+
+// dlx_universe methods
+
+int dlx_universe_write_shards(
+    struct dlx_universe *universe, unsigned int depth, FILE *file) {
+    if (universe->search_state != SEARCH_IDLE || universe->bounds ||
+	universe->symmetries) {
+	return -1;
+    }
+
+    if (shard_expand(universe, universe->search_base, depth, file) ||
+	fflush(file) == EOF) {
+	return -1;
+    }
+
+    return 0;
+}
+
+int dlx_universe_select_shard(struct dlx_universe *universe, FILE *file) {
+    size_t mark = dlx_universe_mark(universe);
+    int c = getc(file), error = 0;
+
+    if (c == EOF) {
+	return 0;
+    }
+
+    // Indices separated by spaces up to the end of the line
+    while (!error && c != '\n' && c != EOF) {
+	size_t subset = 0;
+	int digits = 0;
+
+	while (c == ' ') {
+	    c = getc(file);
+	}
+
+	while (c >= '0' && c <= '9' &&
+	       subset <= (SIZE_MAX - (size_t)(c - '0')) / 10) {
+	    subset = subset * 10 + (size_t)(c - '0');
+	    c = getc(file);
+	    ++digits;
+	}
+
+	// Indices too large to be read are cut short, not split in two
+	if (c >= '0' && c <= '9') {
+	    error = 1;
+	} else if (digits) {
+	    error = dlx_universe_select(universe, subset);
+	} else {
+	    error = c != '\n' && c != EOF;
+	}
+    }
+
+    if (error) {
+	dlx_universe_rollback(universe, mark);
+
+	// The rest of the line is skipped, the next shard may still be read
+	while (c != '\n' && c != EOF) {
+	    c = getc(file);
+	}
+
+	return -1;
+    }
+
+    return 1;
+}
@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx_internal.h"
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * Solution sinks write every solution as the number of subsets it shares
+ * with the previous one, the number of the others and their indices, all as
+ * LEB128 varints. Solutions come in depth first order, so consecutive ones
+ * share most of the solution stack and only the levels that changed are
+ * looked up and written. Sinks on a file descriptor write their buffer out
+ * whenever it holds SINK_FLUSH_SIZE bytes, the others keep everything in
+ * memory.
+ */
+
+#define SINK_FLUSH_SIZE 65536
+
+// A varint of a 64 bit number is at most 10 bytes
+#define VARINT_SIZE 10
+
+struct dlx_sink {
+    int fd;
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+
+    // Nodes of the last solution written
+    uint32_t *previous;
+    size_t previous_size;
+    size_t previous_capacity;
+
+    uint64_t solutions;
+    int error;
+};
+
+size_t varint_encode(uint8_t *data, uint64_t value) {
+    size_t size = 0;
+
+    while (value >= 0x80) {
+	data[size++] = (uint8_t)(value | 0x80);
+	value >>= 7;
+    }
+
+    data[size++] = (uint8_t)value;
+
+    return size;
+}
+
+uint64_t varint_decode(const uint8_t **data) {
+    uint64_t value = 0;
+
+    for (unsigned int shift = 0;; shift += 7) {
+	uint8_t byte = *(*data)++;
+
+	value |= (uint64_t)(byte & 0x7f) << shift;
+
+	if (byte < 0x80) {
+	    return value;
+	}
+    }
+}
+
+// dlx_sink methods
+
+int sink_flush(struct dlx_sink *s) {
+    size_t written = 0;
+
+    while (written < s->size) {
+	ssize_t result = write(s->fd, s->data + written, s->size - written);
+
+	// Writes interrupted by a signal are retried, nothing written is an
+	// error like any other, lest the loop never end
+	if (result < 0 && errno == EINTR) {
+	    continue;
+	}
+
+	if (result <= 0) {
+	    return -1;
+	}
+
+	written += (size_t)result;
+    }
+
+    s->size = 0;
+
+    return 0;
+}
+
+/* Room for `size` more bytes, returns -1 if memory ran out */
+int sink_reserve(struct dlx_sink *s, size_t size) {
+    if (s->size + size <= s->capacity) {
+	return 0;
+    }
+
+    size_t capacity = s->capacity ? s->capacity : SINK_FLUSH_SIZE;
+
+    while (capacity < s->size + size) {
+	capacity *= 2;
+    }
+
+    uint8_t *data = realloc(s->data, capacity);
+
+    if (data == NULL) {
+	return -1;
+    }
+
+    s->data = data;
+    s->capacity = capacity;
+
+    return 0;
+}
+
+int sink_write(struct dlx_sink *s, const struct dlx_solution_iterator *iter) {
+    const uint32_t *solution = iter->solutions;
+    size_t size = iter->end, shared = 0;
+
+    if (size > s->previous_capacity) {
+	uint32_t *previous = realloc(s->previous, sizeof(uint32_t) * size);
+
+	if (previous == NULL) {
+	    return -1;
+	}
+
+	s->previous = previous;
+	s->previous_capacity = size;
+    }
+
+    while (shared < size && shared < s->previous_size &&
+	   solution[shared] == s->previous[shared]) {
+	++shared;
+    }
+
+    if (sink_reserve(s, (size - shared + 2) * VARINT_SIZE)) {
+	return -1;
+    }
+
+    s->size += varint_encode(s->data + s->size, shared);
+    s->size += varint_encode(s->data + s->size, size - shared);
+
+    for (size_t i = shared; i < size; ++i) {
+	s->size += varint_encode(
+	    s->data + s->size, subset_index(iter->nodes, solution[i]));
+	s->previous[i] = solution[i];
+    }
+
+    s->previous_size = size;
+    ++s->solutions;
+
+    return s->fd >= 0 && s->size >= SINK_FLUSH_SIZE ? sink_flush(s) : 0;
+}
+
+/* Write the solution in the iterator, aborting the search on error */
+void sink_append(struct dlx_universe *u) {
+    struct dlx_sink *s = u->sink;
+
+    if (s->error) {
+	return;
+    }
+
+    if (sink_write(s, &u->solution_iterator)) {
+	s->error = 1;
+
+	// Have the search check its budget, and abort, on its next node
+	u->next_check = u->search_nodes;
+    }
+}
+
+int sink_failed(const struct dlx_sink *s) {
+    return s->error;
+}
+
+struct dlx_sink *dlx_sink_new(int fd) {
+    struct dlx_sink *sink = calloc(1, sizeof(struct dlx_sink));
+
+    if (sink != NULL) {
+	sink->fd = fd;
+    }
+
+    return sink;
+}
+
+const uint8_t *dlx_sink_data(struct dlx_sink *sink, size_t *size) {
+    *size = sink->size;
+
+    return sink->data;
+}
+
+uint64_t dlx_sink_solutions(struct dlx_sink *sink) {
+    return sink->solutions;
+}
+
+void dlx_sink_clear(struct dlx_sink *sink) {
+    sink->size = 0;
+    sink->previous_size = 0;
+    sink->solutions = 0;
+    sink->error = 0;
+}
+
+void dlx_sink_free(struct dlx_sink *sink) {
+    free(sink->data);
+    free(sink->previous);
+    free(sink);
+}
+
+size_t dlx_sink_decode(const uint8_t **data, size_t *indices) {
+    size_t shared = (size_t)varint_decode(data);
+    size_t size = shared + (size_t)varint_decode(data);
+
+    for (size_t i = shared; i < size; ++i) {
+	indices[i] = (size_t)varint_decode(data);
+    }
+
+    return size;
+}
+
+// dlx_universe methods
+
+int dlx_universe_search_sink(
+    struct dlx_universe *universe, unsigned int desired_number_of_solutions,
+    struct dlx_sink *sink) {
+    // Solutions of another search share nothing with the last one written
+    sink->previous_size = 0;
+    universe->sink = sink;
+
+    int status = dlx_universe_search(universe, desired_number_of_solutions);
+
+    universe->sink = NULL;
+
+    if (sink->error || (sink->fd >= 0 && sink_flush(sink))) {
+	sink->error = 1;
+	return -1;
+    }
+
+    return status;
+}
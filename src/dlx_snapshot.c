@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx_internal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Snapshots of a universe at rest, in the byte order of the machine that
+ * wrote them: a header, the node arena as it is in memory, the labels as
+ * 64 bit integers and the bounds, if any. The arena is mapped privately
+ * when loading, so the links start out shared with the page cache and a
+ * page is only copied once a search writes to it.
+ */
+
+#define SNAPSHOT_MAGIC "DLXSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+// Flags
+#define SNAPSHOT_BOUNDS 1
+#define SNAPSHOT_REORDERED 2
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t flags;
+    uint32_t node_size;
+    uint64_t columns_size;
+    uint64_t primary_columns_size;
+    uint64_t nodes_size;
+    uint64_t subsets_size;
+};
+
+void snapshot_unmap(struct dlx_universe *u) {
+    munmap(u->mapping, u->mapping_size);
+    u->mapping = NULL;
+}
+
+/* Expected size of a file with `header` */
+uint64_t snapshot_size(const struct snapshot_header *header) {
+    return sizeof(struct snapshot_header) +
+	   header->nodes_size * sizeof(struct dlx_node) +
+	   header->subsets_size * sizeof(uint64_t) +
+	   (header->flags & SNAPSHOT_BOUNDS
+		? header->columns_size * sizeof(struct dlx_bounds)
+		: 0);
+}
+
+int snapshot_check(const struct snapshot_header *header, uint64_t size) {
+    return size >= sizeof(struct snapshot_header) &&
+		   memcmp(header->magic, SNAPSHOT_MAGIC, 8) == 0 &&
+		   header->version == SNAPSHOT_VERSION &&
+		   header->byte_order == SNAPSHOT_BYTE_ORDER &&
+		   header->node_size == sizeof(struct dlx_node) &&
+		   header->columns_size >= 1 &&
+		   header->columns_size < INT32_MAX &&
+		   header->primary_columns_size < header->columns_size &&
+		   header->nodes_size > header->columns_size &&
+		   header->nodes_size <= UINT32_MAX &&
+		   header->subsets_size < header->nodes_size &&
+		   snapshot_size(header) == size
+	       ? 0
+	       : -1;
+}
+
+/* Write the labels as integers, a block at a time */
+int snapshot_write_labels(FILE *file, const struct dlx_universe *u) {
+    uint64_t ids[512];
+
+    for (size_t i = 0; i < u->subsets_size; i += 512) {
+	size_t size = u->subsets_size - i < 512 ? u->subsets_size - i : 512;
+
+	for (size_t j = 0; j < size; ++j) {
+	    ids[j] = (uint64_t)(uintptr_t)u->subset_labels[i + j];
+	}
+
+	if (fwrite(ids, sizeof(uint64_t), size, file) != size) {
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+// dlx_universe methods
+
+int dlx_universe_save(struct dlx_universe *universe, const char *path) {
+    struct snapshot_header header = {
+	.magic = SNAPSHOT_MAGIC,
+	.version = SNAPSHOT_VERSION,
+	.byte_order = SNAPSHOT_BYTE_ORDER,
+	.flags = (universe->bounds ? SNAPSHOT_BOUNDS : 0) |
+		 (universe->rows_reordered ? SNAPSHOT_REORDERED : 0),
+	.node_size = sizeof(struct dlx_node),
+	.columns_size = universe->columns_size,
+	.primary_columns_size = universe->primary_columns_size,
+	.nodes_size = universe->nodes_size,
+	.subsets_size = universe->subsets_size,
+    };
+
+    // The links are only as they were built when no subset is chosen
+    if (universe->search_state != SEARCH_IDLE || universe->search_base) {
+	return -1;
+    }
+
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL) {
+	return -1;
+    }
+
+    int error =
+	fwrite(&header, sizeof(header), 1, file) != 1 ||
+	fwrite(
+	    universe->nodes, sizeof(struct dlx_node), universe->nodes_size,
+	    file) != universe->nodes_size ||
+	snapshot_write_labels(file, universe) ||
+	(universe->bounds &&
+	 fwrite(
+	     universe->bounds, sizeof(struct dlx_bounds),
+	     universe->columns_size, file) != universe->columns_size);
+
+    if (fclose(file) || error) {
+	remove(path);
+	return -1;
+    }
+
+    return 0;
+}
+
+struct dlx_universe *dlx_universe_load(
+    const char *path,
+    void (*solution_handler)(struct dlx_solution_iterator *iter)) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+	return NULL;
+    }
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 &&
+	(uint64_t)st.st_size >= sizeof(struct snapshot_header)) {
+	mapping = mmap(
+	    NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+	    0);
+    }
+
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+	return NULL;
+    }
+
+    const struct snapshot_header *header = mapping;
+    struct dlx_universe *universe = NULL;
+
+    if (snapshot_check(header, (uint64_t)st.st_size) == 0) {
+	universe = dlx_universe_new(
+	    solution_handler, header->primary_columns_size,
+	    header->columns_size - 1 - header->primary_columns_size,
+	    header->subsets_size);
+    }
+
+    if (universe == NULL) {
+	munmap(mapping, (size_t)st.st_size);
+	return NULL;
+    }
+
+    free(universe->nodes);
+    universe->mapping = mapping;
+    universe->mapping_size = (size_t)st.st_size;
+    universe->nodes = (struct dlx_node *)(header + 1);
+    universe->nodes_size = universe->nodes_capacity = header->nodes_size;
+    universe->subsets_size = header->subsets_size;
+    universe->rows_reordered = (header->flags & SNAPSHOT_REORDERED) != 0;
+
+    const uint64_t *ids = (const uint64_t *)(universe->nodes +
+					     universe->nodes_size);
+
+    for (size_t i = 0; i < universe->subsets_size; ++i) {
+	universe->subset_labels[i] = (void *)(uintptr_t)ids[i];
+    }
+
+    for (uint32_t i = 1; i <= universe->small_columns.limit; ++i) {
+	small_columns_resize(
+	    &universe->small_columns, i, 0, universe->nodes[i].top);
+    }
+
+    if (header->flags & SNAPSHOT_BOUNDS) {
+	const struct dlx_bounds *bounds =
+	    (const struct dlx_bounds *)(ids + universe->subsets_size);
+
+	for (size_t i = 1; i <= universe->primary_columns_size; ++i) {
+	    if ((bounds[i].bound != 1 || bounds[i].slack != 0) &&
+		dlx_universe_set_bounds(
+		    universe, i - 1,
+		    (unsigned int)(bounds[i].bound - bounds[i].slack),
+		    (unsigned int)bounds[i].bound)) {
+		dlx_universe_free(universe);
+		return NULL;
+	    }
+	}
+    }
+
+    return universe;
+}
@@ -0,0 +1,430 @@
+#include "dlx_internal.h"
+
+/*
+ * Branching strategies: which column the search branches on, by default the
+ * first with the fewest rows, and the order in which the rows of a column
+ * are tried, the order of its list. Searches looking for a single solution
+ * can be restarted with both randomized, so an unlucky early choice does not
+ * doom the whole run.
+ */
+
+// Random numbers
+
+/* Vigna's SplitMix64 */
+uint64_t random_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+    return z ^ (z >> 31);
+}
+
+/*
+ * Random number below `n`, by Lemire's multiply-shift: the high half of a
+ * random number times `n`, drawing again when the low half falls among the
+ * 2^64 mod n values that would make some results more likely than others
+ */
+uint64_t random_below(uint64_t *state, uint64_t n) {
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 product = (uint128)random_next(state) * n;
+
+    if ((uint64_t)product < n) {
+	uint64_t threshold = -n % n;
+
+	while ((uint64_t)product < threshold) {
+	    product = (uint128)random_next(state) * n;
+	}
+    }
+
+    return (uint64_t)(product >> 64);
+}
+
+// dlx_small_columns methods
+
+/* The `n`th column, counting from 0, of the ones with `size` rows */
+uint32_t small_columns_nth(
+    const struct dlx_small_columns *s, int size, uint64_t n) {
+    const uint64_t *bits = s->bits[size];
+    size_t i = 0;
+
+    while (n >= (uint64_t)__builtin_popcountll(bits[i])) {
+	n -= (uint64_t)__builtin_popcountll(bits[i++]);
+    }
+
+    uint64_t word = bits[i];
+
+    while (n--) {
+	word &= word - 1;
+    }
+
+    return (uint32_t)(i * 64 + (size_t)__builtin_ctzll(word));
+}
+
+/* Random column with the fewest rows, if it has at most one, or else 0 */
+uint32_t small_columns_random(
+    const struct dlx_small_columns *s, uint64_t *state) {
+    int size = s->counts[0] ? 0 : 1;
+
+    if (s->counts[size] == 0) {
+	return 0;
+    }
+
+    return small_columns_nth(s, size, random_below(state, s->counts[size]));
+}
+
+// Column choice
+
+/* Column with the fewest rows, chosen uniformly among ties */
+uint32_t choose_column_random(struct dlx_universe *u) {
+    const struct dlx_node *nodes = u->nodes;
+    uint32_t column =
+	small_columns_random(&u->small_columns, &u->random_state);
+
+    if (column) {
+	return column;
+    }
+
+    uint64_t ties = 0;
+
+    for (uint32_t it = u->columns[0].right; it != 0;
+	 it = u->columns[it].right) {
+	if (ties == 0 || nodes[it].top < nodes[column].top) {
+	    column = it;
+	    ties = 1;
+	} else if (
+	    nodes[it].top == nodes[column].top &&
+	    random_below(&u->random_state, ++ties) == 0) {
+	    column = it;
+	}
+    }
+
+    return column;
+}
+
+uint32_t cells_choose_column_random(struct dlx_universe *u) {
+    const struct dlx_cells *c = u->cells;
+    uint32_t column = small_columns_random(&c->small_columns, &u->random_state);
+
+    if (column) {
+	return column;
+    }
+
+    uint64_t ties = 1;
+
+    column = c->active[0];
+
+    for (uint32_t i = 1; i < c->active_size; ++i) {
+	uint32_t size = c->columns[c->active[i]].size;
+
+	if (size < c->columns[column].size) {
+	    column = c->active[i];
+	    ties = 1;
+	} else if (
+	    size == c->columns[column].size &&
+	    random_below(&u->random_state, ++ties) == 0) {
+	    column = c->active[i];
+	}
+    }
+
+    return column;
+}
+
+/* Column picked by the chooser among the `count` gathered for it */
+uint32_t chooser_call(struct dlx_universe *u, size_t count) {
+    size_t i = (*u->chooser)(
+	u->chooser_columns, u->chooser_sizes, count, u->chooser_data);
+
+    return (uint32_t)u->chooser_columns[i < count ? i : 0] + 1;
+}
+
+uint32_t choose_column_custom(struct dlx_universe *u) {
+    size_t count = 0;
+
+    for (uint32_t it = u->columns[0].right; it != 0;
+	 it = u->columns[it].right) {
+	u->chooser_columns[count] = it - 1;
+	u->chooser_sizes[count++] = (size_t)u->nodes[it].top;
+    }
+
+    return chooser_call(u, count);
+}
+
+uint32_t cells_choose_column_custom(struct dlx_universe *u) {
+    const struct dlx_cells *c = u->cells;
+
+    for (uint32_t i = 0; i < c->active_size; ++i) {
+	u->chooser_columns[i] = c->active[i] - 1;
+	u->chooser_sizes[i] = c->columns[c->active[i]].size;
+    }
+
+    return chooser_call(u, c->active_size);
+}
+
+/* Column chosen by the chooser if set, or else at random among ties */
+uint32_t choose_column_strategy(struct dlx_universe *u) {
+    return u->chooser ? choose_column_custom(u) : choose_column_random(u);
+}
+
+uint32_t cells_choose_column_strategy(struct dlx_universe *u) {
+    return u->chooser ? cells_choose_column_custom(u)
+		      : cells_choose_column_random(u);
+}
+
+/* Room for the chooser's arguments, one entry per primary column */
+int chooser_reserve(struct dlx_universe *u) {
+    size_t size = u->primary_columns_size ? u->primary_columns_size : 1;
+
+    u->chooser_columns = malloc(sizeof(size_t) * 2 * size);
+    u->chooser_sizes = u->chooser_columns + size;
+
+    return u->chooser_columns == NULL ? -1 : 0;
+}
+
+// Row order
+
+struct row_order {
+    double priority;
+    uint32_t position;
+    uint32_t node;
+};
+
+/* By priority, rows with the same one keeping their order */
+int row_order_compare(const void *a, const void *b) {
+    const struct row_order *x = a, *y = b;
+
+    if (x->priority != y->priority) {
+	return x->priority < y->priority ? -1 : 1;
+    }
+
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+/*
+ * Buffer for the rows of any column, NULL if a search, pushed subsets or
+ * reductions are in the way: rows taken out of the columns keep links to
+ * their neighbours of the time, to be relinked in the same place
+ */
+struct row_order *rows_buffer(const struct dlx_universe *u) {
+    if (u->search_state != SEARCH_IDLE || u->search_base ||
+	u->reduce_log_size) {
+	return NULL;
+    }
+
+    int32_t size = 1;
+
+    for (uint32_t column = 1; column < u->columns_size; ++column) {
+	if (u->nodes[column].top > size) {
+	    size = u->nodes[column].top;
+	}
+    }
+
+    return malloc(sizeof(struct row_order) * (size_t)size);
+}
+
+/* Gather the rows of `column` in their current order, returning how many */
+uint32_t rows_gather(
+    const struct dlx_universe *u, uint32_t column, struct row_order *rows) {
+    uint32_t size = 0;
+
+    FOREACH(row, u->nodes, column, node_down) {
+	rows[size].priority = 0;
+	rows[size].position = size;
+	rows[size++].node = row;
+    }
+
+    return size;
+}
+
+/* Relink the rows of `column` in the order of `rows` */
+void rows_relink(
+    struct dlx_universe *u, uint32_t column, const struct row_order *rows,
+    uint32_t size) {
+    struct dlx_node *nodes = u->nodes;
+    uint32_t previous = column;
+
+    for (uint32_t i = 0; i < size; ++i) {
+	nodes[previous].down = rows[i].node;
+	nodes[rows[i].node].up = previous;
+	previous = rows[i].node;
+    }
+
+    nodes[previous].down = column;
+    nodes[column].up = previous;
+}
+
+/* The cells follow the new order once rebuilt */
+void rows_reordered(struct dlx_universe *u) {
+    u->rows_reordered = 1;
+
+    if (u->cells) {
+	u->cells->nodes_size = 0;
+    }
+}
+
+/* Fisher-Yates shuffle of every column */
+void rows_shuffle(
+    struct dlx_universe *u, struct row_order *rows, uint64_t *state) {
+    for (uint32_t column = 1; column < u->columns_size; ++column) {
+	uint32_t size = rows_gather(u, column, rows);
+
+	for (uint32_t i = size; i > 1; --i) {
+	    uint32_t j = (uint32_t)random_below(state, i);
+	    struct row_order row = rows[i - 1];
+
+	    rows[i - 1] = rows[j];
+	    rows[j] = row;
+	}
+
+	rows_relink(u, column, rows, size);
+    }
+
+    rows_reordered(u);
+}
+
+/* Term `i` of Luby's sequence 1, 1, 2, 1, 1, 2, 4, 1, ... from i = 1 */
+uint64_t luby(uint64_t i) {
+    for (;;) {
+	uint64_t power = 2;
+
+	while (power - 1 < i) {
+	    power *= 2;
+	}
+
+	if (power - 1 == i) {
+	    return power / 2;
+	}
+
+	i -= power / 2 - 1;
+    }
+}
+
+// dlx_universe methods
+
+void dlx_universe_set_choice(
+    struct dlx_universe *universe, int choice, uint64_t seed) {
+    universe->choice = choice;
+    universe->random_state = seed;
+}
+
+int dlx_universe_set_chooser(
+    struct dlx_universe *universe,
+    size_t (*chooser)(
+	const size_t *columns, const size_t *sizes, size_t count, void *data),
+    void *data) {
+    if (chooser && universe->chooser_columns == NULL &&
+	chooser_reserve(universe)) {
+	return -1;
+    }
+
+    universe->chooser = chooser;
+    universe->chooser_data = data;
+
+    return 0;
+}
+
+int dlx_universe_order_rows(
+    struct dlx_universe *universe, double (*priority)(void *label, void *data),
+    void *data) {
+    struct row_order *rows = rows_buffer(universe);
+
+    if (rows == NULL) {
+	return -1;
+    }
+
+    for (uint32_t column = 1; column < universe->columns_size; ++column) {
+	uint32_t size = rows_gather(universe, column, rows);
+
+	for (uint32_t i = 0; i < size; ++i) {
+	    rows[i].priority = (*priority)(
+		universe->subset_labels[subset_index(
+		    universe->nodes, rows[i].node)],
+		data);
+	}
+
+	qsort(rows, size, sizeof(struct row_order), &row_order_compare);
+	rows_relink(universe, column, rows, size);
+    }
+
+    rows_reordered(universe);
+    free(rows);
+
+    return 0;
+}
+
+int dlx_universe_shuffle_rows(struct dlx_universe *universe, uint64_t seed) {
+    struct row_order *rows = rows_buffer(universe);
+
+    if (rows == NULL) {
+	return -1;
+    }
+
+    rows_shuffle(universe, rows, &seed);
+    free(rows);
+
+    return 0;
+}
+
+int dlx_universe_search_restarts(
+    struct dlx_universe *universe, uint64_t unit, uint64_t seed) {
+    uint64_t max_nodes = universe->max_nodes, nodes = 0;
+    double max_seconds = universe->max_seconds;
+    double deadline = seconds_now() + max_seconds;
+    uint64_t random_state = universe->random_state;
+    int choice = universe->choice, status = DLX_SEARCH_ABORTED;
+
+    dlx_universe_search_abort(universe);
+
+    // Rows can't be shuffled under pushed subsets or reductions, only ties
+    // are random then
+    struct row_order *rows = rows_buffer(universe);
+
+    universe->choice = DLX_CHOOSE_RANDOM;
+    unit = unit ? unit : 1;
+
+    for (uint64_t run = 1;; ++run) {
+	uint64_t term = luby(run);
+	uint64_t budget = term > UINT64_MAX / unit ? UINT64_MAX : term * unit;
+
+	if (max_nodes) {
+	    if (nodes >= max_nodes) {
+		break;
+	    }
+
+	    budget = budget < max_nodes - nodes ? budget : max_nodes - nodes;
+	}
+
+	if (max_seconds > 0) {
+	    universe->max_seconds = deadline - seconds_now();
+
+	    if (universe->max_seconds <= 0) {
+		break;
+	    }
+	}
+
+	universe->random_state = random_next(&seed);
+
+	if (rows) {
+	    rows_shuffle(universe, rows, &universe->random_state);
+	}
+
+	universe->max_nodes = budget;
+	status = dlx_universe_search(universe, 1);
+	nodes += universe->search_nodes;
+
+	// Only runs stopped by their node budget are restarted, not the ones
+	// stopped by the clock or the progress callback
+	if (status != DLX_SEARCH_ABORTED || universe->search_nodes < budget) {
+	    break;
+	}
+    }
+
+    universe->max_nodes = max_nodes;
+    universe->max_seconds = max_seconds;
+    universe->choice = choice;
+    universe->random_state = random_state;
+    universe->search_status = status;
+    free(rows);
+
+    return status;
+}
@@ -0,0 +1,562 @@
+#include "dlx_internal.h"
+#include <string.h>
+
+/*
+ * Symmetry breaking by lex-leader constraints: solutions are ordered as
+ * sets of subset indices, the one holding the smallest index they don't
+ * share coming first, and only the first solution of every orbit under the
+ * group of symmetries, its canonical solution, is searched for. Checking
+ * against every element of the group, rather than the symmetries added,
+ * makes it unique.
+ *
+ * At every node of the search a subset is in the solution, out of it, if
+ * it was hidden or its primary columns covered, or still open. An image of
+ * the solution is compared with it from the smallest index up, and the node
+ * is pruned if they agree on the known subsets until the image holds one
+ * that the solution lacks, as every solution below it then has an image
+ * that comes first.
+ */
+
+// Most elements of the group the symmetries generate
+#define SYMMETRIES_MAX 1024
+
+// State of a subset at a search node
+#define SYMMETRY_OUT 1
+#define SYMMETRY_IN 2
+#define SYMMETRY_OPEN 3
+
+uint64_t symmetry_hash(const uint32_t *image, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < size; ++i) {
+	hash = (hash ^ image[i]) * 0x100000001b3;
+    }
+
+    return hash;
+}
+
+// dlx_symmetries methods
+
+struct dlx_symmetries *symmetries_new(size_t subsets_size, size_t levels) {
+    struct dlx_symmetries *s = calloc(1, sizeof(struct dlx_symmetries));
+
+    if (s == NULL) {
+	return NULL;
+    }
+
+    s->subsets_size = subsets_size;
+    s->first_nodes = malloc(sizeof(uint32_t) * (subsets_size + 1));
+    s->marks = calloc(subsets_size + 1, sizeof(uint64_t));
+    s->subsets = malloc(sizeof(uint32_t) * levels);
+    s->solution = malloc(sizeof(uint32_t) * levels);
+
+    if (s->first_nodes == NULL || s->marks == NULL || s->subsets == NULL ||
+	s->solution == NULL) {
+	symmetries_free(s);
+	return NULL;
+    }
+
+    return s;
+}
+
+void symmetries_free(struct dlx_symmetries *s) {
+    if (s == NULL) {
+	return;
+    }
+
+    free(s->generators);
+    free(s->images);
+    free(s->inverses);
+    free(s->first_nodes);
+    free(s->marks);
+    free(s->subsets);
+    free(s->solution);
+    free(s);
+}
+
+/* Copy of the symmetries with scratch space of its own, for another thread */
+struct dlx_symmetries *symmetries_clone(
+    const struct dlx_symmetries *s, size_t levels) {
+    struct dlx_symmetries *clone = symmetries_new(s->subsets_size, levels);
+    size_t n = s->subsets_size;
+
+    if (clone == NULL) {
+	return NULL;
+    }
+
+    clone->generators = malloc(sizeof(uint32_t) * n * s->generators_size);
+    clone->images = malloc(sizeof(uint32_t) * n * s->size);
+    clone->inverses = malloc(sizeof(size_t) * s->size);
+
+    if (clone->generators == NULL || clone->images == NULL ||
+	clone->inverses == NULL) {
+	symmetries_free(clone);
+	return NULL;
+    }
+
+    memcpy(
+	clone->generators, s->generators,
+	sizeof(uint32_t) * n * s->generators_size);
+    memcpy(clone->images, s->images, sizeof(uint32_t) * n * s->size);
+    memcpy(clone->inverses, s->inverses, sizeof(size_t) * s->size);
+    memcpy(clone->first_nodes, s->first_nodes, sizeof(uint32_t) * n);
+    clone->generators_size = s->generators_size;
+    clone->size = s->size;
+
+    return clone;
+}
+
+/*
+ * Keep the permutation in the slot after the last element of `images` as a
+ * new element, unless it is the identity or an element already
+ */
+void symmetries_keep(
+    uint32_t *images, uint64_t *hashes, size_t *size, size_t n) {
+    const uint32_t *image = images + *size * n;
+    uint64_t hash = symmetry_hash(image, n);
+    size_t k = 0;
+
+    while (k < n && image[k] == k) {
+	++k;
+    }
+
+    if (k == n) {
+	return;
+    }
+
+    for (size_t i = 0; i < *size; ++i) {
+	if (hashes[i] == hash &&
+	    memcmp(images + i * n, image, sizeof(uint32_t) * n) == 0) {
+	    return;
+	}
+    }
+
+    hashes[(*size)++] = hash;
+}
+
+/*
+ * Elements of the group generated by the generators, found by composing
+ * the ones found so far with every generator until no new one comes up.
+ * Returns -1 if there are more than SYMMETRIES_MAX or memory ran out.
+ */
+int symmetries_close(struct dlx_symmetries *s) {
+    size_t n = s->subsets_size, size = 0;
+    uint32_t *images = malloc(sizeof(uint32_t) * n * (SYMMETRIES_MAX + 1));
+    uint64_t *hashes = malloc(sizeof(uint64_t) * (SYMMETRIES_MAX + 1));
+    size_t *inverses = NULL;
+    int result = -1;
+
+    if (images == NULL || hashes == NULL) {
+	goto done;
+    }
+
+    for (size_t g = 0; g < s->generators_size && size < SYMMETRIES_MAX; ++g) {
+	memcpy(images + size * n, s->generators + g * n, sizeof(uint32_t) * n);
+	symmetries_keep(images, hashes, &size, n);
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+	for (size_t g = 0; g < s->generators_size; ++g) {
+	    if (size == SYMMETRIES_MAX) {
+		goto done;
+	    }
+
+	    for (size_t k = 0; k < n; ++k) {
+		uint32_t k_image = s->generators[g * n + k];
+
+		images[size * n + k] = images[i * n + k_image];
+	    }
+
+	    symmetries_keep(images, hashes, &size, n);
+	}
+    }
+
+    // Every element's inverse is another element, the one composing with
+    // it to the identity
+    inverses = malloc(sizeof(size_t) * (size ? size : 1));
+
+    if (inverses == NULL) {
+	goto done;
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+	const uint32_t *element = images + i * n;
+
+	for (size_t j = 0; j < size; ++j) {
+	    const uint32_t *other = images + j * n;
+	    size_t k = 0;
+
+	    while (k < n && other[element[k]] == k) {
+		++k;
+	    }
+
+	    if (k == n) {
+		inverses[i] = j;
+		break;
+	    }
+	}
+    }
+
+    // The closure was built in room for the largest group
+    uint32_t *shrunk = realloc(images, sizeof(uint32_t) * n * (size + 1));
+
+    if (shrunk) {
+	images = shrunk;
+    }
+
+    free(s->images);
+    free(s->inverses);
+    s->images = images;
+    s->inverses = inverses;
+    s->size = size;
+    images = NULL;
+    inverses = NULL;
+    result = 0;
+
+done:
+    free(images);
+    free(hashes);
+    free(inverses);
+
+    return result;
+}
+
+/* Whether subset `subset` is in the solution, out of it or still open */
+int symmetry_state(struct dlx_universe *u, uint32_t subset) {
+    struct dlx_symmetries *s = u->symmetries;
+    const struct dlx_node *nodes = u->nodes;
+    const struct dlx_column *columns = u->columns;
+
+    if (s->marks[subset] >> 2 == s->epoch) {
+	return (int)(s->marks[subset] & 3);
+    }
+
+    // A subset with no primary column is never chosen, and one still open
+    // has all of its nodes linked and its primary columns active
+    int state = SYMMETRY_OUT;
+
+    for (uint32_t it = s->first_nodes[subset]; nodes[it].top > 0; ++it) {
+	uint32_t column = (uint32_t)nodes[it].top;
+
+	if (nodes[nodes[it].up].down != it) {
+	    state = SYMMETRY_OUT;
+	    break;
+	}
+
+	if (column <= u->primary_columns_size) {
+	    if (columns[columns[column].left].right != column) {
+		state = SYMMETRY_OUT;
+		break;
+	    }
+
+	    state = SYMMETRY_OPEN;
+	}
+    }
+
+    s->marks[subset] = s->epoch << 2 | (uint64_t)state;
+
+    return state;
+}
+
+static inline int symmetry_in(
+    const struct dlx_symmetries *s, uint32_t subset) {
+    return s->marks[subset] == (s->epoch << 2 | SYMMETRY_IN);
+}
+
+/*
+ * Returns 1 if every solution below the search node at `level` has an
+ * image coming before it, so that it can be pruned. At a solution it tells
+ * whether it is not canonical, and leaves its subsets in `subsets` for
+ * `symmetry_orbit` and `symmetry_report_orbit`.
+ */
+int symmetry_prune(struct dlx_universe *u, size_t level) {
+    struct dlx_symmetries *s = u->symmetries;
+    size_t n = s->subsets_size;
+
+    ++s->epoch;
+
+    for (size_t l = 0; l < level; ++l) {
+	uint32_t subset =
+	    (uint32_t)subset_index(u->nodes, u->solution_stack[l]);
+
+	s->subsets[l] = subset;
+	s->marks[subset] = s->epoch << 2 | SYMMETRY_IN;
+    }
+
+    for (size_t g = 0; g < s->size; ++g) {
+	const uint32_t *image = s->images + g * n;
+
+	// The image holds subset i if the solution holds `image[i]`
+	for (uint32_t i = 0; i < n; ++i) {
+	    if (image[i] == i) {
+		continue;
+	    }
+
+	    int state = symmetry_state(u, i);
+	    int image_state = symmetry_state(u, image[i]);
+
+	    if (state == SYMMETRY_OPEN || image_state == SYMMETRY_OPEN) {
+		break;
+	    }
+
+	    if (state != image_state) {
+		if (image_state == SYMMETRY_IN) {
+		    return 1;
+		}
+
+		break;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Whether the image of the solution at `level` by element `g` is the
+ * solution itself or its image by an element before `g`
+ */
+int symmetry_repeated(const struct dlx_symmetries *s, size_t g, size_t level) {
+    size_t n = s->subsets_size;
+    const uint32_t *image = s->images + g * n;
+    size_t l = 0;
+
+    while (l < level && symmetry_in(s, image[s->subsets[l]])) {
+	++l;
+    }
+
+    if (l == level) {
+	return 1;
+    }
+
+    // Both images are the same if the inverse of the earlier element takes
+    // this image back to the solution
+    for (size_t h = 0; h < g; ++h) {
+	const uint32_t *inverse = s->images + s->inverses[h] * n;
+
+	l = 0;
+
+	while (l < level && symmetry_in(s, inverse[image[s->subsets[l]]])) {
+	    ++l;
+	}
+
+	if (l == level) {
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/* Number of solutions the canonical solution at `level` stands for */
+uint64_t symmetry_orbit(const struct dlx_universe *u, size_t level) {
+    const struct dlx_symmetries *s = u->symmetries;
+
+    if (u->symmetry_report == DLX_SYMMETRY_CANONICAL) {
+	return 1;
+    }
+
+    // The orbit has as many solutions as the group has elements for every
+    // one leaving the solution as it is
+    uint64_t stabilizer = 1;
+
+    for (size_t g = 0; g < s->size; ++g) {
+	const uint32_t *image = s->images + g * s->subsets_size;
+	size_t l = 0;
+
+	while (l < level && symmetry_in(s, image[s->subsets[l]])) {
+	    ++l;
+	}
+
+	stabilizer += l == level;
+    }
+
+    return (s->size + 1) / stabilizer;
+}
+
+/*
+ * Pass the other solutions in the orbit of the canonical solution at
+ * `level` to the sink or handler, returns 1 once the search found as many
+ * solutions as desired
+ */
+int symmetry_report_orbit(struct dlx_universe *u, size_t level) {
+    struct dlx_symmetries *s = u->symmetries;
+
+    if (u->symmetry_report == DLX_SYMMETRY_CANONICAL) {
+	return 0;
+    }
+
+    for (size_t g = 0; g < s->size; ++g) {
+	const uint32_t *image = s->images + g * s->subsets_size;
+
+	if (symmetry_repeated(s, g, level)) {
+	    continue;
+	}
+
+	for (size_t l = 0; l < level; ++l) {
+	    s->solution[l] = s->first_nodes[image[s->subsets[l]]];
+	}
+
+	u->solution_iterator.solutions = s->solution;
+	u->solution_iterator.index = 0;
+	++u->number_of_solutions_found;
+	STAT(u, ++stats->solutions);
+
+	search_report(u);
+
+	if (u->desired_number_of_solutions &&
+	    u->number_of_solutions_found == u->desired_number_of_solutions) {
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/* Whether subset `subset` is subset `image` once its columns are mapped */
+int symmetry_maps(
+    const struct dlx_universe *u, const struct dlx_symmetries *s,
+    const size_t *columns, size_t subset, size_t image) {
+    const struct dlx_node *nodes = u->nodes;
+    uint32_t first = s->first_nodes[subset];
+    uint32_t image_first = s->first_nodes[image];
+    uint32_t size = 0, image_size = 0;
+
+    while (nodes[first + size].top > 0) {
+	++size;
+    }
+
+    while (nodes[image_first + image_size].top > 0) {
+	++image_size;
+    }
+
+    if (size != image_size) {
+	return 0;
+    }
+
+    for (uint32_t i = first; i < first + size; ++i) {
+	size_t column = columns[(size_t)nodes[i].top - 1] + 1;
+	uint32_t j = image_first;
+
+	while (j < image_first + size &&
+	       ((size_t)nodes[j].top != column ||
+		nodes[j].color != nodes[i].color)) {
+	    ++j;
+	}
+
+	if (j == image_first + size) {
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/* Whether `map` is a permutation of `size` indices */
+int symmetry_permutes(const size_t *map, size_t size, uint8_t *seen) {
+    memset(seen, 0, size);
+
+    for (size_t i = 0; i < size; ++i) {
+	if (map[i] >= size || seen[map[i]]) {
+	    return 0;
+	}
+
+	seen[map[i]] = 1;
+    }
+
+    return 1;
+}
+
+// dlx_universe methods
+
+int dlx_universe_add_symmetry(
+    struct dlx_universe *universe, const size_t *columns,
+    const size_t *subsets) {
+    size_t n = universe->subsets_size;
+    size_t columns_size = universe->columns_size - 1;
+
+    if (universe->search_state != SEARCH_IDLE || universe->bounds ||
+	universe->reduce_log_size || universe->search_base ||
+	(universe->symmetries && universe->symmetries->subsets_size != n) ||
+	n == 0 || subset_first(universe, n - 1) == 0) {
+	return -1;
+    }
+
+    uint8_t *seen = malloc(n > columns_size ? n : columns_size);
+    struct dlx_symmetries *s = universe->symmetries;
+    int valid = seen != NULL &&
+		symmetry_permutes(columns, columns_size, seen) &&
+		symmetry_permutes(subsets, n, seen);
+
+    for (size_t c = 0; valid && c < columns_size; ++c) {
+	valid = (c < universe->primary_columns_size) ==
+		(columns[c] < universe->primary_columns_size);
+    }
+
+    free(seen);
+
+    if (!valid) {
+	return -1;
+    }
+
+    if (s == NULL) {
+	s = symmetries_new(n, universe->solution_stack_capacity);
+
+	if (s == NULL) {
+	    return -1;
+	}
+
+	memcpy(s->first_nodes, universe->subset_nodes, sizeof(uint32_t) * n);
+    }
+
+    for (size_t i = 0; valid && i < n; ++i) {
+	valid = symmetry_maps(universe, s, columns, i, subsets[i]);
+    }
+
+    uint32_t *generators = valid ? realloc(
+				       s->generators,
+				       sizeof(uint32_t) * n *
+					   (s->generators_size + 1))
+				 : NULL;
+
+    if (generators == NULL) {
+	if (universe->symmetries == NULL) {
+	    symmetries_free(s);
+	}
+
+	return -1;
+    }
+
+    s->generators = generators;
+
+    for (size_t i = 0; i < n; ++i) {
+	generators[s->generators_size * n + i] = (uint32_t)subsets[i];
+    }
+
+    ++s->generators_size;
+
+    if (symmetries_close(s)) {
+	--s->generators_size;
+
+	if (universe->symmetries == NULL) {
+	    symmetries_free(s);
+	}
+
+	return -1;
+    }
+
+    universe->symmetries = s;
+
+    return 0;
+}
+
+void dlx_universe_clear_symmetries(struct dlx_universe *universe) {
+    dlx_universe_search_abort(universe);
+    symmetries_free(universe->symmetries);
+    universe->symmetries = NULL;
+}
+
+void dlx_universe_set_symmetry_report(
+    struct dlx_universe *universe, int report) {
+    universe->symmetry_report = report;
+}
@@ -0,0 +1,630 @@
+#include "dlx_internal.h"
+#include <string.h>
+
+/*
+ * Decision diagrams of all the solutions, built as in Knuth's Algorithm Z:
+ * the search branches on a column like Algorithm X, but the solutions of
+ * every subproblem are only worked out once and then shared, the
+ * subproblem being given by the active primary columns and what was done
+ * to each secondary column, left alone, covered or purified with a color.
+ *
+ * A subproblem whose column has rows r1, ..., rk is a chain of nodes, the
+ * node of ri taking ri as its HI branch, followed by the diagram of the
+ * subproblem it leaves, and the node of ri+1 as its LO branch. Rows with no
+ * solution below them get no node, so the diagram is zero-suppressed,
+ * though its variables are not ordered the same way along every path.
+ *
+ * Numbers of solutions are exact, as little endian arrays of 32 bit limbs,
+ * and both branches of a node come before it, so they are added up in one
+ * pass over the nodes once the diagram is built.
+ */
+
+// Sinks, node 0 has no solution and node 1 the empty one
+#define ZDD_FALSE 0
+#define ZDD_TRUE 1
+
+// State of a covered secondary column in a key, colors being positive
+#define ZDD_COVERED UINT32_MAX
+
+struct zdd_node {
+    uint32_t subset;
+    uint32_t lo, hi;
+};
+
+struct dlx_zdd {
+    struct zdd_node *nodes;
+    size_t size;
+    size_t capacity;
+    uint32_t root;
+
+    // Subsets selected or forced before the diagram was built, which are
+    // part of every solution
+    size_t *selected;
+    size_t selected_size;
+
+    // Number of solutions below node i, from limb `count_offsets[i]` to
+    // `count_offsets[i + 1]` excluded of `counts`, with no leading zero limb
+    uint32_t *counts;
+    size_t *count_offsets;
+};
+
+/* Subproblem already solved and the node of its diagram */
+struct zdd_memo {
+    uint64_t hash;
+    size_t key;
+    uint32_t node;
+};
+
+/*
+ * The key of the subproblem being searched: a bit per primary column, set
+ * while it is active, then the state of every secondary column
+ */
+struct zdd_builder {
+    struct dlx_universe *universe;
+    struct dlx_zdd *zdd;
+
+    uint32_t *key;
+    size_t key_size;
+    size_t primary_words;
+
+    // Keys of the memo entries, `key_size` words each, the entries refer
+    // to theirs by position plus one, 0 for an empty entry
+    uint32_t *keys;
+    size_t keys_size;
+    size_t keys_capacity;
+
+    struct zdd_memo *memo;
+    size_t memo_size;
+    size_t memo_capacity;
+
+    int failed;
+};
+
+// zdd_builder methods
+
+uint64_t zdd_hash(const struct zdd_builder *z) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < z->key_size; ++i) {
+	hash = (hash ^ z->key[i]) * 0x100000001b3;
+    }
+
+    return hash ^ hash >> 32;
+}
+
+/* Entry holding the current key, or the empty one it would go to */
+struct zdd_memo *zdd_lookup(const struct zdd_builder *z, uint64_t hash) {
+    size_t mask = z->memo_capacity - 1;
+
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+	struct zdd_memo *m = z->memo + i;
+
+	if (m->key == 0 ||
+	    (m->hash == hash &&
+	     memcmp(
+		 z->keys + (m->key - 1) * z->key_size, z->key,
+		 sizeof(uint32_t) * z->key_size) == 0)) {
+	    return m;
+	}
+    }
+}
+
+int zdd_memo_grow(struct zdd_builder *z) {
+    size_t capacity = z->memo_capacity * 2;
+    struct zdd_memo *memo = calloc(capacity, sizeof(struct zdd_memo));
+
+    if (memo == NULL) {
+	return -1;
+    }
+
+    for (size_t i = 0; i < z->memo_capacity; ++i) {
+	struct zdd_memo *m = z->memo + i;
+
+	if (m->key) {
+	    size_t j = (size_t)m->hash & (capacity - 1);
+
+	    while (memo[j].key) {
+		j = (j + 1) & (capacity - 1);
+	    }
+
+	    memo[j] = *m;
+	}
+    }
+
+    free(z->memo);
+    z->memo = memo;
+    z->memo_capacity = capacity;
+
+    return 0;
+}
+
+/* Remember the current key's node, returns -1 if memory ran out */
+int zdd_remember(struct zdd_builder *z, uint64_t hash, uint32_t node) {
+    if (2 * (z->memo_size + 1) > z->memo_capacity && zdd_memo_grow(z)) {
+	return -1;
+    }
+
+    if (z->keys_size + z->key_size > z->keys_capacity) {
+	size_t capacity = 2 * z->keys_capacity;
+	uint32_t *keys = realloc(z->keys, sizeof(uint32_t) * capacity);
+
+	if (keys == NULL) {
+	    return -1;
+	}
+
+	z->keys = keys;
+	z->keys_capacity = capacity;
+    }
+
+    struct zdd_memo *m = zdd_lookup(z, hash);
+
+    memcpy(z->keys + z->keys_size, z->key, sizeof(uint32_t) * z->key_size);
+    z->keys_size += z->key_size;
+
+    m->hash = hash;
+    m->key = ++z->memo_size;
+    m->node = node;
+
+    return 0;
+}
+
+/* Node for `subset` with branches `lo` and `hi`, UINT32_MAX without memory */
+uint32_t zdd_add(
+    struct zdd_builder *z, size_t subset, uint32_t lo, uint32_t hi) {
+    struct dlx_zdd *zdd = z->zdd;
+
+    if (zdd->size == zdd->capacity) {
+	size_t capacity = 2 * zdd->capacity;
+	struct zdd_node *nodes =
+	    capacity < UINT32_MAX
+		? realloc(zdd->nodes, sizeof(struct zdd_node) * capacity)
+		: NULL;
+
+	if (nodes == NULL) {
+	    return UINT32_MAX;
+	}
+
+	zdd->nodes = nodes;
+	zdd->capacity = capacity;
+    }
+
+    zdd->nodes[zdd->size].subset = (uint32_t)subset;
+    zdd->nodes[zdd->size].lo = lo;
+    zdd->nodes[zdd->size].hi = hi;
+
+    return (uint32_t)zdd->size++;
+}
+
+/* Set the state of primary or secondary column `column` in the key */
+void zdd_set(struct zdd_builder *z, uint32_t column, uint32_t state) {
+    size_t primary = z->universe->primary_columns_size;
+
+    if (column > primary) {
+	z->key[z->primary_words + column - primary - 1] = state;
+    } else if (state) {
+	z->key[(column - 1) / 32] |= (uint32_t)1 << (column - 1) % 32;
+    } else {
+	z->key[(column - 1) / 32] &= ~((uint32_t)1 << (column - 1) % 32);
+    }
+}
+
+/*
+ * Record what committing `node` does to its column: a primary one becomes
+ * inactive and a secondary one covered or purified with the node's color
+ */
+void zdd_commit(struct zdd_builder *z, uint32_t node) {
+    const struct dlx_node *nodes = z->universe->nodes;
+    uint32_t column = (uint32_t)nodes[node].top;
+    int32_t color = nodes[node].color;
+
+    if (color < 0) {
+	return;
+    }
+
+    if (column <= z->universe->primary_columns_size) {
+	zdd_set(z, column, 0);
+    } else {
+	zdd_set(z, column, color ? (uint32_t)color : ZDD_COVERED);
+    }
+}
+
+void zdd_uncommit(struct zdd_builder *z, uint32_t node) {
+    const struct dlx_node *nodes = z->universe->nodes;
+    uint32_t column = (uint32_t)nodes[node].top;
+
+    if (nodes[node].color >= 0) {
+	zdd_set(z, column, column <= z->universe->primary_columns_size);
+    }
+}
+
+/* Returns 1 once the node or time budget ran out */
+int zdd_out_of_budget(const struct dlx_universe *u) {
+    return (u->max_nodes && u->search_nodes >= u->max_nodes) ||
+	   (u->max_seconds > 0 && u->search_nodes % TIME_CHECK_INTERVAL == 0 &&
+	    seconds_now() >= u->deadline);
+}
+
+/* Node of the diagram of the subproblem left, setting `failed` on error */
+uint32_t zdd_build(struct zdd_builder *z, size_t level) {
+    struct dlx_universe *u = z->universe;
+    struct dlx_node *nodes = u->nodes;
+
+    if (u->columns[0].right == 0) {
+	return ZDD_TRUE;
+    }
+
+    uint64_t hash = zdd_hash(z);
+    struct zdd_memo *m = zdd_lookup(z, hash);
+
+    if (m->key) {
+	return m->node;
+    }
+
+    if (zdd_out_of_budget(u)) {
+	z->failed = 1;
+	return ZDD_FALSE;
+    }
+
+    ++u->search_nodes;
+    STAT(u, stats_node(stats, level));
+
+    uint32_t column = choose_column(u), result = ZDD_FALSE;
+
+    cover(u, column);
+    zdd_set(z, column, 0);
+
+    // Rows are taken from the last so that a node's LO branch, the chain
+    // of the rows after it, comes before it
+    FOREACH(row, nodes, column, node_up) {
+	FOREACH(j, nodes, row, node_right) {
+	    zdd_commit(z, j);
+	    commit(u, j);
+	}
+
+	uint32_t hi = zdd_build(z, level + 1);
+
+	FOREACH(j, nodes, row, node_left) {
+	    uncommit(u, j);
+	    zdd_uncommit(z, j);
+	}
+
+	if (z->failed) {
+	    break;
+	}
+
+	if (hi != ZDD_FALSE) {
+	    result = zdd_add(z, subset_index(nodes, row), result, hi);
+
+	    if (result == UINT32_MAX) {
+		z->failed = 1;
+		break;
+	    }
+	}
+    }
+
+    zdd_set(z, column, 1);
+    uncover(u, column);
+
+    if (!z->failed && zdd_remember(z, hash, result)) {
+	z->failed = 1;
+    }
+
+    return result;
+}
+
+/* Key of the subproblem left by the subsets pushed below the search */
+void zdd_key_init(struct zdd_builder *z) {
+    struct dlx_universe *u = z->universe;
+    const struct dlx_node *nodes = u->nodes;
+
+    memset(z->key, 0, sizeof(uint32_t) * z->key_size);
+
+    for (uint32_t c = u->columns[0].right; c != 0; c = u->columns[c].right) {
+	zdd_set(z, c, 1);
+    }
+
+    for (size_t level = 0; level < u->search_base; ++level) {
+	FOREACH(j, nodes, u->solution_stack[level], node_right) {
+	    if ((size_t)nodes[j].top > u->primary_columns_size) {
+		zdd_commit(z, j);
+	    }
+	}
+    }
+}
+
+// dlx_zdd methods
+
+const uint32_t *zdd_count(
+    const struct dlx_zdd *zdd, size_t node, size_t *size) {
+    *size = zdd->count_offsets[node + 1] - zdd->count_offsets[node];
+
+    return zdd->counts + zdd->count_offsets[node];
+}
+
+/* Count the solutions below every node, returns -1 if memory ran out */
+int zdd_count_all(struct dlx_zdd *zdd) {
+    size_t capacity = 2 * zdd->size;
+
+    zdd->count_offsets = malloc(sizeof(size_t) * (zdd->size + 1));
+    zdd->counts = malloc(sizeof(uint32_t) * capacity);
+
+    if (zdd->count_offsets == NULL || zdd->counts == NULL) {
+	return -1;
+    }
+
+    zdd->count_offsets[0] = zdd->count_offsets[1] = 0;
+    zdd->counts[0] = 1;
+    zdd->count_offsets[2] = 1;
+
+    for (size_t i = 2; i < zdd->size; ++i) {
+	size_t lo_size, hi_size, offset = zdd->count_offsets[i];
+	size_t lo_offset = zdd->count_offsets[zdd->nodes[i].lo],
+	       hi_offset = zdd->count_offsets[zdd->nodes[i].hi];
+
+	lo_size = zdd->count_offsets[zdd->nodes[i].lo + 1] - lo_offset;
+	hi_size = zdd->count_offsets[zdd->nodes[i].hi + 1] - hi_offset;
+
+	size_t size = (lo_size > hi_size ? lo_size : hi_size) + 1;
+
+	if (offset + size > capacity) {
+	    while (offset + size > capacity) {
+		capacity *= 2;
+	    }
+
+	    uint32_t *counts =
+		realloc(zdd->counts, sizeof(uint32_t) * capacity);
+
+	    if (counts == NULL) {
+		return -1;
+	    }
+
+	    zdd->counts = counts;
+	}
+
+	uint64_t carry = 0;
+
+	for (size_t k = 0; k < size; ++k) {
+	    carry += k < lo_size ? zdd->counts[lo_offset + k] : 0;
+	    carry += k < hi_size ? zdd->counts[hi_offset + k] : 0;
+	    zdd->counts[offset + k] = (uint32_t)carry;
+	    carry >>= 32;
+	}
+
+	if (zdd->counts[offset + size - 1] == 0) {
+	    --size;
+	}
+
+	zdd->count_offsets[i + 1] = offset + size;
+    }
+
+    return 0;
+}
+
+/* Compare numbers with no leading zero limbs */
+int zdd_compare(
+    const uint32_t *a, size_t a_size, const uint32_t *b, size_t b_size) {
+    if (a_size != b_size) {
+	return a_size < b_size ? -1 : 1;
+    }
+
+    for (size_t i = a_size; i-- > 0;) {
+	if (a[i] != b[i]) {
+	    return a[i] < b[i] ? -1 : 1;
+	}
+    }
+
+    return 0;
+}
+
+/* Subtract `b` from `a`, at least as large, returns the size of the result */
+size_t zdd_subtract(
+    uint32_t *a, size_t a_size, const uint32_t *b, size_t b_size) {
+    int64_t borrow = 0;
+
+    for (size_t i = 0; i < a_size; ++i) {
+	borrow += (int64_t)a[i] - (i < b_size ? (int64_t)b[i] : 0);
+	a[i] = (uint32_t)borrow;
+	borrow = borrow < 0 ? -1 : 0;
+    }
+
+    while (a_size > 0 && a[a_size - 1] == 0) {
+	--a_size;
+    }
+
+    return a_size;
+}
+
+void dlx_zdd_free(struct dlx_zdd *zdd) {
+    free(zdd->nodes);
+    free(zdd->selected);
+    free(zdd->counts);
+    free(zdd->count_offsets);
+    free(zdd);
+}
+
+size_t dlx_zdd_size(struct dlx_zdd *zdd) {
+    return zdd->size;
+}
+
+size_t dlx_zdd_root(struct dlx_zdd *zdd) {
+    return zdd->root;
+}
+
+size_t dlx_zdd_node(struct dlx_zdd *zdd, size_t node, size_t *lo, size_t *hi) {
+    *lo = zdd->nodes[node].lo;
+    *hi = zdd->nodes[node].hi;
+
+    return zdd->nodes[node].subset;
+}
+
+size_t dlx_zdd_count(struct dlx_zdd *zdd, char *buffer, size_t size) {
+    size_t limbs_size;
+    const uint32_t *count = zdd_count(zdd, zdd->root, &limbs_size);
+
+    // Every limb makes at most two groups of 9 digits, taken off the copy
+    // from the least significant one
+    uint32_t *limbs = malloc(sizeof(uint32_t) * (3 * limbs_size + 1));
+    uint32_t *groups = limbs + limbs_size;
+    size_t groups_size = 0;
+
+    if (limbs == NULL) {
+	return 0;
+    }
+
+    memcpy(limbs, count, sizeof(uint32_t) * limbs_size);
+
+    do {
+	uint64_t remainder = 0;
+
+	for (size_t i = limbs_size; i-- > 0;) {
+	    remainder = remainder << 32 | limbs[i];
+	    limbs[i] = (uint32_t)(remainder / 1000000000);
+	    remainder %= 1000000000;
+	}
+
+	groups[groups_size++] = (uint32_t)remainder;
+
+	while (limbs_size > 0 && limbs[limbs_size - 1] == 0) {
+	    --limbs_size;
+	}
+    } while (limbs_size > 0);
+
+    int length = snprintf(buffer, size, "%u", groups[--groups_size]);
+
+    while (groups_size > 0) {
+	size_t offset = (size_t)length < size ? (size_t)length : size;
+
+	length += snprintf(
+	    buffer ? buffer + offset : NULL, size - offset, "%09u",
+	    groups[--groups_size]);
+    }
+
+    free(limbs);
+
+    return (size_t)length;
+}
+
+size_t dlx_zdd_sample(struct dlx_zdd *zdd, uint64_t *state, size_t *indices) {
+    size_t count_size;
+    const uint32_t *count = zdd_count(zdd, zdd->root, &count_size);
+
+    if (count_size == 0) {
+	return SIZE_MAX;
+    }
+
+    uint32_t *r = malloc(sizeof(uint32_t) * count_size);
+
+    if (r == NULL) {
+	return SIZE_MAX;
+    }
+
+    // Draw below the count by rejection, with the top limb masked to its
+    // bits so that a draw is accepted at least half of the time
+    uint32_t mask = UINT32_MAX >> __builtin_clz(count[count_size - 1]);
+    size_t r_size;
+
+    do {
+	for (size_t i = 0; i < count_size; ++i) {
+	    r[i] = (uint32_t)random_next(state);
+	}
+
+	r[count_size - 1] &= mask;
+	r_size = count_size;
+
+	while (r_size > 0 && r[r_size - 1] == 0) {
+	    --r_size;
+	}
+    } while (zdd_compare(r, r_size, count, count_size) >= 0);
+
+    // Solutions through the LO branch of a node are numbered first
+    size_t size = zdd->selected_size;
+    uint32_t node = zdd->root;
+
+    memcpy(indices, zdd->selected, sizeof(size_t) * size);
+
+    while (node > ZDD_TRUE) {
+	size_t lo_size;
+	const uint32_t *lo = zdd_count(zdd, zdd->nodes[node].lo, &lo_size);
+
+	if (zdd_compare(r, r_size, lo, lo_size) < 0) {
+	    node = zdd->nodes[node].lo;
+	} else {
+	    r_size = zdd_subtract(r, r_size, lo, lo_size);
+	    indices[size++] = zdd->nodes[node].subset;
+	    node = zdd->nodes[node].hi;
+	}
+    }
+
+    free(r);
+
+    return size;
+}
+
+// dlx_universe methods
+
+struct dlx_zdd *dlx_universe_zdd(struct dlx_universe *universe) {
+    dlx_universe_search_abort(universe);
+
+    if (universe->bounds) {
+	return NULL;
+    }
+
+    size_t primary_words = (universe->primary_columns_size + 31) / 32;
+    struct zdd_builder z = {
+	.universe = universe,
+	.primary_words = primary_words,
+	.key_size = primary_words + universe->columns_size -
+		    universe->primary_columns_size - 1,
+	.memo_capacity = 1024,
+    };
+    struct dlx_zdd *zdd = calloc(1, sizeof(struct dlx_zdd));
+
+    z.zdd = zdd;
+    z.keys_capacity = z.key_size * 512 + 1;
+    z.key = malloc(sizeof(uint32_t) * (z.key_size + 1));
+    z.keys = malloc(sizeof(uint32_t) * z.keys_capacity);
+    z.memo = calloc(z.memo_capacity, sizeof(struct zdd_memo));
+
+    if (zdd == NULL || z.key == NULL || z.keys == NULL || z.memo == NULL) {
+	z.failed = 1;
+    } else {
+	zdd->capacity = 1024;
+	zdd->size = 2;
+	zdd->nodes = malloc(sizeof(struct zdd_node) * zdd->capacity);
+	zdd->selected_size = universe->search_base;
+	zdd->selected = malloc(sizeof(size_t) * (zdd->selected_size + 1));
+	z.failed = zdd->nodes == NULL || zdd->selected == NULL;
+    }
+
+    if (!z.failed) {
+	for (size_t i = 0; i < zdd->selected_size; ++i) {
+	    zdd->selected[i] =
+		subset_index(universe->nodes, universe->solution_stack[i]);
+	}
+
+	memset(zdd->nodes, 0, sizeof(struct zdd_node) * 2);
+
+	universe->search_nodes = 0;
+	universe->deadline = seconds_now() + universe->max_seconds;
+
+	zdd_key_init(&z);
+	zdd->root = zdd_build(&z, universe->search_base);
+	universe->search_status =
+	    z.failed ? DLX_SEARCH_ABORTED : DLX_SEARCH_FINISHED;
+    }
+
+    free(z.key);
+    free(z.keys);
+    free(z.memo);
+
+    if (!z.failed && zdd_count_all(zdd)) {
+	z.failed = 1;
+    }
+
+    if (z.failed && zdd != NULL) {
+	dlx_zdd_free(zdd);
+	return NULL;
+    }
+
+    return zdd;
+}
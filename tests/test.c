@@ -0,0 +1,1405 @@
+// # test
+//
+// Differential test of the library on small random matrices: the exact
+// covers of every matrix are found by trying every set of its rows, and
+// every way the library has to search them must find the same ones, each
+// once:
+//
+// 	search    the solution handler, for all solutions and for one
+// 	resume    searches suspended every few nodes, and aborted
+// 	pull      the pull interface
+// 	parallel  parallel searches and counts at several split depths
+// 	count     counts
+// 	stats     the solutions counted by the statistics
+// 	budget    searches cut short by a budget of nodes
+// 	cells     the searches above on the cells
+// 	random    random choices, a chooser, shuffled rows and restarts
+// 	builders  the subsets added from arrays and in compressed rows
+// 	snapshot  snapshots saved and loaded back
+// 	reader    the matrix written in the DLX format and read back
+// 	sink      sinks, their solutions decoded
+// 	reduce    every reduction, then the matrix restored
+// 	select    single subsets and pairs selected, then rolled back
+// 	batch     batches of instances each selecting one subset
+// 	zdd       decision diagrams of the solutions
+// 	symmetry  every solution or only the canonical ones of every orbit
+// 	estimate  estimates of the search
+// 	shards    shards written and searched one after the other
+// 	restore   searches suspended at several points, checkpointed and
+// 	          restored on another universe
+//
+// Parallel searches of the 10 queens are then long enough for their tasks to
+// be split for idle threads, which the small matrices never are.
+//
+// Some matrices have
+//
+// - colored secondary columns
+// - bounds on their primary columns
+// - 64 to 80 primary columns, for the bitsets of small columns
+// - a symmetry
+//
+// Links must also be exactly as built after every search and after anything
+// undoing a change to the matrix, which is checked on the nodes and columns
+// themselves, and the bitsets of small columns must agree with them.
+// Failures are reported with the seed of their matrix, which `-s` with `-n 1`
+// tests alone.
+//
+// 	usage: test [-n matrices] [-s seed]
+//
+// 	-n  test this many matrices, 500 by default
+// 	-s  seed of the first matrix, the next ones following it, 1 by default
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "dlx_internal.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_PRIMARY 6
+#define MAX_SECONDARY 3
+#define WIDE_PRIMARY 80
+#define WIDE_BLOCKS 4
+#define MAX_COLUMNS (WIDE_PRIMARY + MAX_SECONDARY)
+#define MAX_ROW_SIZE 24
+#define MAX_ROWS 14
+#define MAX_COVERS ((uint32_t)1 << MAX_ROWS)
+
+// ## Matrices
+//
+// Rows list their columns in increasing order, every one with at least a
+// primary column since searches only ever choose rows through them, and no
+// two rows are the same. Symmetric matrices are closed under a permutation
+// swapping pairs of primary columns and pairs of secondary ones.
+
+struct row {
+    size_t size;
+    uint32_t columns[MAX_ROW_SIZE];
+    uint32_t colors[MAX_ROW_SIZE];
+};
+
+struct matrix {
+    size_t primary, secondary, size;
+    struct row rows[MAX_ROWS];
+    unsigned int lo[MAX_COLUMNS], hi[MAX_COLUMNS];
+    int colored, bounded, symmetric;
+    size_t column_images[MAX_COLUMNS], row_images[MAX_ROWS];
+};
+
+/*
+ * Columns of a row as arguments, alone or each followed by its color: the
+ * ones past its size are not read
+ */
+#define ROW_COLUMNS(r) (r)->columns[0], (r)->columns[1], (r)->columns[2],      \
+    (r)->columns[3], (r)->columns[4], (r)->columns[5], (r)->columns[6],        \
+    (r)->columns[7], (r)->columns[8], (r)->columns[9], (r)->columns[10],       \
+    (r)->columns[11], (r)->columns[12], (r)->columns[13], (r)->columns[14],    \
+    (r)->columns[15], (r)->columns[16], (r)->columns[17], (r)->columns[18],    \
+    (r)->columns[19], (r)->columns[20], (r)->columns[21], (r)->columns[22],    \
+    (r)->columns[23]
+#define ROW_COLORED(r) (r)->columns[0], (r)->colors[0], (r)->columns[1],       \
+    (r)->colors[1], (r)->columns[2], (r)->colors[2], (r)->columns[3],          \
+    (r)->colors[3], (r)->columns[4], (r)->colors[4], (r)->columns[5],          \
+    (r)->colors[5], (r)->columns[6], (r)->colors[6], (r)->columns[7],          \
+    (r)->colors[7], (r)->columns[8], (r)->colors[8], (r)->columns[9],          \
+    (r)->colors[9], (r)->columns[10], (r)->colors[10], (r)->columns[11],       \
+    (r)->colors[11], (r)->columns[12], (r)->colors[12], (r)->columns[13],      \
+    (r)->colors[13], (r)->columns[14], (r)->colors[14], (r)->columns[15],      \
+    (r)->colors[15], (r)->columns[16], (r)->colors[16], (r)->columns[17],      \
+    (r)->colors[17], (r)->columns[18], (r)->colors[18], (r)->columns[19],      \
+    (r)->colors[19], (r)->columns[20], (r)->colors[20], (r)->columns[21],      \
+    (r)->colors[21], (r)->columns[22], (r)->colors[22], (r)->columns[23],      \
+    (r)->colors[23]
+
+/* SplitMix64, below `n` */
+static uint64_t draw(uint64_t *state, uint64_t n) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+    return (z ^ (z >> 31)) % n;
+}
+
+static void row_draw(const struct matrix *m, struct row *r, uint64_t *state) {
+    do {
+	memset(r, 0, sizeof(*r));
+
+	for (uint32_t c = 0; c < m->primary + m->secondary; ++c) {
+	    if (draw(state, 3) == 0) {
+		r->colors[r->size] = m->colored && c >= m->primary
+					 ? (uint32_t)draw(state, 3)
+					 : 0;
+		r->columns[r->size++] = c;
+	    }
+	}
+    } while (r->size == 0 || r->columns[0] >= m->primary);
+}
+
+static void row_image(
+    const struct matrix *m, const struct row *r, struct row *image) {
+    memset(image, 0, sizeof(*image));
+    image->size = r->size;
+
+    for (size_t i = 0; i < r->size; ++i) {
+	uint32_t column = (uint32_t)m->column_images[r->columns[i]];
+	size_t j = i;
+
+	for (; j > 0 && image->columns[j - 1] > column; --j) {
+	    image->columns[j] = image->columns[j - 1];
+	    image->colors[j] = image->colors[j - 1];
+	}
+
+	image->columns[j] = column;
+	image->colors[j] = r->colors[i];
+    }
+}
+
+/* Index of the row equal to `r`, or the number of rows */
+static size_t matrix_find(const struct matrix *m, const struct row *r) {
+    size_t i = 0;
+
+    while (i < m->size && memcmp(m->rows + i, r, sizeof(*r)) != 0) {
+	++i;
+    }
+
+    return i;
+}
+
+/*
+ * Add a row of the primary columns from `first` to `last` excluded but
+ * `hole`, sometimes with a secondary column too, unless it has no primary
+ * column left or is there already
+ */
+static void matrix_add_range(
+    struct matrix *m, size_t first, size_t last, size_t hole,
+    uint64_t *state) {
+    struct row r;
+
+    memset(&r, 0, sizeof(r));
+
+    for (size_t c = first; c < last; ++c) {
+	if (c != hole) {
+	    r.columns[r.size++] = (uint32_t)c;
+	}
+    }
+
+    if (r.size == 0 || m->size == MAX_ROWS) {
+	return;
+    }
+
+    if (m->secondary && draw(state, 3) == 0) {
+	r.colors[r.size] = m->colored ? (uint32_t)draw(state, 3) : 0;
+	r.columns[r.size++] =
+	    (uint32_t)(m->primary + (size_t)draw(state, m->secondary));
+    }
+
+    if (matrix_find(m, &r) == m->size) {
+	m->rows[m->size++] = r;
+    }
+}
+
+/*
+ * Wide matrices have their primary columns cut in blocks, each a row of its
+ * own and sometimes also split in two rows, so that they have a cover for
+ * every choice of split blocks, with a few short rows in the way. A column
+ * is sometimes left out of every row, leaving no cover at all.
+ */
+static void matrix_draw_wide(struct matrix *m, uint64_t *state) {
+    size_t hole;
+
+    m->primary = WIDE_PRIMARY - (size_t)draw(state, WIDE_PRIMARY - 63);
+    m->secondary = (size_t)draw(state, MAX_SECONDARY + 1);
+    m->colored = draw(state, 2) == 0;
+    m->bounded = draw(state, 3) == 0;
+    hole = draw(state, 4) == 0 ? (size_t)draw(state, m->primary) : m->primary;
+
+    // Bounded matrices have a few columns that may be covered more than once
+    // or not at all
+    for (size_t c = 0; c < m->primary; ++c) {
+	m->hi[c] = m->bounded && draw(state, 8) == 0
+		       ? 1 + (unsigned int)draw(state, 3)
+		       : 1;
+	m->lo[c] = m->hi[c] > 1 ? (unsigned int)draw(state, 2) : 1;
+    }
+
+    for (size_t b = 0; b < WIDE_BLOCKS; ++b) {
+	size_t first = m->primary * b / WIDE_BLOCKS;
+	size_t last = m->primary * (b + 1) / WIDE_BLOCKS;
+
+	matrix_add_range(m, first, last, hole, state);
+
+	if (draw(state, 2) == 0) {
+	    size_t middle = first + 1 + (size_t)draw(state, last - first - 1);
+
+	    matrix_add_range(m, first, middle, hole, state);
+	    matrix_add_range(m, middle, last, hole, state);
+	}
+    }
+
+    while (m->size < MAX_ROWS && draw(state, 2) == 0) {
+	size_t first = (size_t)draw(state, m->primary - 2);
+
+	matrix_add_range(
+	    m, first, first + 1 + (size_t)draw(state, 3), hole, state);
+    }
+}
+
+/* Swap the columns from `first` to `last` excluded in random pairs */
+static void matrix_pair(
+    struct matrix *m, size_t first, size_t last, uint64_t *state) {
+    size_t columns[MAX_COLUMNS];
+
+    for (size_t i = first; i < last; ++i) {
+	size_t j = first + (size_t)draw(state, i - first + 1);
+
+	columns[i] = columns[j];
+	columns[j] = i;
+    }
+
+    for (size_t i = first; i + 1 < last; i += 2) {
+	m->column_images[columns[i]] = columns[i + 1];
+	m->column_images[columns[i + 1]] = columns[i];
+    }
+}
+
+static void matrix_draw(struct matrix *m, uint64_t seed) {
+    uint64_t state = seed;
+    size_t size = 1 + (size_t)draw(&state, MAX_ROWS);
+
+    memset(m, 0, sizeof(*m));
+
+    if (draw(&state, 8) == 0) {
+	matrix_draw_wide(m, &state);
+	return;
+    }
+
+    m->primary = 1 + (size_t)draw(&state, MAX_PRIMARY);
+    m->secondary = (size_t)draw(&state, MAX_SECONDARY + 1);
+    m->colored = draw(&state, 2) == 0;
+    m->bounded = draw(&state, 4) == 0;
+    m->symmetric = !m->bounded && draw(&state, 3) == 0;
+
+    for (size_t c = 0; c < MAX_COLUMNS; ++c) {
+	m->column_images[c] = c;
+    }
+
+    for (size_t c = 0; c < m->primary; ++c) {
+	m->hi[c] = m->bounded ? 1 + (unsigned int)draw(&state, 3) : 1;
+	m->lo[c] = m->bounded ? (unsigned int)draw(&state, m->hi[c] + 1) : 1;
+    }
+
+    if (m->symmetric) {
+	matrix_pair(m, 0, m->primary, &state);
+	matrix_pair(m, m->primary, m->primary + m->secondary, &state);
+    }
+
+    for (unsigned int attempt = 0; m->size < size && attempt < 100;
+	 ++attempt) {
+	struct row r, image;
+
+	row_draw(m, &r, &state);
+	row_image(m, &r, &image);
+
+	int fixed = memcmp(&r, &image, sizeof(r)) == 0;
+
+	if (matrix_find(m, &r) < m->size ||
+	    m->size + 2 > size + (size_t)fixed) {
+	    continue;
+	}
+
+	m->rows[m->size] = r;
+	m->row_images[m->size] = m->size + 1 - (size_t)fixed;
+	++m->size;
+
+	if (!fixed) {
+	    m->rows[m->size] = image;
+	    m->row_images[m->size] = m->size - 1;
+	    ++m->size;
+	}
+    }
+}
+
+/* Rows are labeled with their index */
+static dlx_universe matrix_build(
+    const struct matrix *m, void (*handler)(dlx_solution_iterator iter)) {
+    dlx_universe u = dlx_universe_new(handler, m->primary, m->secondary, 0);
+
+    if (u == NULL) {
+	return NULL;
+    }
+
+    for (size_t i = 0; i < m->size; ++i) {
+	const struct row *r = m->rows + i;
+	void *label = (void *)(uintptr_t)i;
+
+	int error =
+	    m->colored
+		? dlx_universe_add_colored_subset(
+		      u, r->size, label, ROW_COLORED(r))
+		: dlx_universe_add_subset(u, r->size, label, ROW_COLUMNS(r));
+
+	if (error) {
+	    dlx_universe_free(u);
+	    return NULL;
+	}
+    }
+
+    for (size_t c = 0; m->bounded && c < m->primary; ++c) {
+	if ((m->lo[c] != 1 || m->hi[c] != 1) &&
+	    dlx_universe_set_bounds(u, c, m->lo[c], m->hi[c])) {
+	    dlx_universe_free(u);
+	    return NULL;
+	}
+    }
+
+    if (m->symmetric &&
+	dlx_universe_add_symmetry(u, m->column_images, m->row_images)) {
+	dlx_universe_free(u);
+	return NULL;
+    }
+
+    return u;
+}
+
+/* Universes that could not be built are left out as they are */
+static void universe_free(dlx_universe u) {
+    if (u) {
+	dlx_universe_free(u);
+    }
+}
+
+// ## Brute force
+//
+// Every set of rows is a bitmask of their indices. A primary column must be
+// covered within its bounds, a secondary one at most once or by rows all
+// giving it the same color.
+
+struct reference {
+    uint32_t covers[MAX_COVERS];
+    size_t size;
+    uint64_t orbits;
+    unsigned char valid[MAX_COVERS];
+};
+
+static int brute_covers(const struct matrix *m, uint32_t set) {
+    unsigned int counts[MAX_COLUMNS] = {0};
+    uint32_t colors[MAX_COLUMNS] = {0};
+
+    for (size_t i = 0; i < m->size; ++i) {
+	const struct row *r = m->rows + i;
+
+	for (size_t k = 0; (set >> i & 1) && k < r->size; ++k) {
+	    uint32_t c = r->columns[k], color = r->colors[k];
+
+	    if (c >= m->primary &&
+		counts[c] && (color == 0 || colors[c] != color)) {
+		return 0;
+	    }
+
+	    ++counts[c];
+	    colors[c] = color;
+	}
+    }
+
+    for (size_t c = 0; c < m->primary; ++c) {
+	if (counts[c] < m->lo[c] || counts[c] > m->hi[c]) {
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+static uint32_t brute_image(const struct matrix *m, uint32_t set) {
+    uint32_t image = 0;
+
+    for (size_t i = 0; i < m->size; ++i) {
+	image |= (set >> i & 1) << m->row_images[i];
+    }
+
+    return image;
+}
+
+static void brute_force(const struct matrix *m, struct reference *r) {
+    memset(r->valid, 0, sizeof(r->valid));
+    r->size = 0;
+    r->orbits = 0;
+
+    for (uint32_t set = 0; set < (uint32_t)1 << m->size; ++set) {
+	if (!brute_covers(m, set)) {
+	    continue;
+	}
+
+	r->valid[set] = 1;
+	r->covers[r->size++] = set;
+
+	// The symmetry is an involution, every orbit has one set no larger
+	// than its image
+	if (!m->symmetric || set <= brute_image(m, set)) {
+	    ++r->orbits;
+	}
+    }
+}
+
+/* Covers holding every subset of `set` */
+static uint64_t brute_count(const struct reference *r, uint32_t set) {
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < r->size; ++i) {
+	count += (r->covers[i] & set) == set;
+    }
+
+    return count;
+}
+
+// ## Checks
+//
+// Solutions found are recorded against the reference, from any thread.
+
+static struct {
+    pthread_mutex_t lock;
+    const struct reference *reference;
+    unsigned char seen[MAX_COVERS];
+    uint64_t found;
+    uint64_t wrong;
+} solutions = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t matrix_seed;
+static unsigned long checks, failures;
+
+static void record_set(uint32_t set, int wrong) {
+    pthread_mutex_lock(&solutions.lock);
+    ++solutions.found;
+
+    if (wrong || !solutions.reference->valid[set] || solutions.seen[set]++) {
+	++solutions.wrong;
+    }
+
+    pthread_mutex_unlock(&solutions.lock);
+}
+
+static void record(dlx_solution_iterator iter) {
+    uint32_t set = 0;
+    int wrong = 0;
+
+    while (dlx_solution_iterator_remaining(iter)) {
+	size_t i = (size_t)(uintptr_t)dlx_solution_iterator_next(iter);
+
+	wrong |= i >= MAX_ROWS || (set >> i & 1);
+	set |= i < MAX_ROWS ? (uint32_t)1 << i : 0;
+    }
+
+    record_set(set, wrong);
+}
+
+static void ignore(dlx_solution_iterator iter) { (void)iter; }
+
+static void record_begin(const struct reference *r) {
+    solutions.reference = r;
+    solutions.found = 0;
+    solutions.wrong = 0;
+    memset(solutions.seen, 0, sizeof(solutions.seen));
+}
+
+static void expect(const char *what, uint64_t found, uint64_t expected) {
+    ++checks;
+
+    if (found != expected) {
+	fprintf(
+	    stderr, "test: seed %llu: %s: %llu solutions instead of %llu\n",
+	    (unsigned long long)matrix_seed, what, (unsigned long long)found,
+	    (unsigned long long)expected);
+	++failures;
+    }
+}
+
+static void expect_true(const char *what, int condition) {
+    ++checks;
+
+    if (!condition) {
+	fprintf(
+	    stderr, "test: seed %llu: %s failed\n",
+	    (unsigned long long)matrix_seed, what);
+	++failures;
+    }
+}
+
+/* The solutions recorded since record_begin, each a valid one found once */
+static void record_end(const char *what, uint64_t expected) {
+    expect(what, solutions.found, expected);
+    ++checks;
+
+    if (solutions.wrong) {
+	fprintf(
+	    stderr, "test: seed %llu: %s: %llu invalid or repeated solutions\n",
+	    (unsigned long long)matrix_seed, what,
+	    (unsigned long long)solutions.wrong);
+	++failures;
+    }
+}
+
+/* Nodes and columns as built, to compare with after the matrix changed */
+struct links {
+    struct dlx_node *nodes;
+    size_t nodes_size;
+    struct dlx_column *columns;
+    size_t columns_size;
+};
+
+static struct links built;
+
+static int links_save(struct links *l, const struct dlx_universe *u) {
+    l->nodes_size = u->nodes_size;
+    l->columns_size = u->columns_size;
+    l->nodes = malloc(sizeof(struct dlx_node) * l->nodes_size);
+    l->columns = malloc(sizeof(struct dlx_column) * l->columns_size);
+
+    if (l->nodes == NULL || l->columns == NULL) {
+	free(l->nodes);
+	free(l->columns);
+	return -1;
+    }
+
+    memcpy(l->nodes, u->nodes, sizeof(struct dlx_node) * l->nodes_size);
+    memcpy(
+	l->columns, u->columns, sizeof(struct dlx_column) * l->columns_size);
+
+    return 0;
+}
+
+static void links_free(struct links *l) {
+    free(l->nodes);
+    free(l->columns);
+}
+
+/* The bitsets of small columns hold the active ones their sizes tell */
+static int small_columns_match(const struct dlx_universe *u) {
+    const struct dlx_small_columns *s = &u->small_columns;
+    size_t words = (u->columns_size + 63) / 64;
+    uint64_t bits[2][(MAX_COLUMNS + 64) / 64] = {{0}};
+    size_t counts[2] = {0, 0};
+
+    for (uint32_t c = u->columns[0].right; c != 0; c = u->columns[c].right) {
+	int32_t size = u->nodes[c].top;
+
+	if (c <= s->limit && size <= 1) {
+	    bits[size][c / 64] |= (uint64_t)1 << c % 64;
+	    ++counts[size];
+	}
+    }
+
+    return s->counts[0] == counts[0] && s->counts[1] == counts[1] &&
+	   memcmp(s->bits[0], bits[0], sizeof(uint64_t) * words) == 0 &&
+	   memcmp(s->bits[1], bits[1], sizeof(uint64_t) * words) == 0;
+}
+
+static void expect_links(
+    const char *what, const struct links *l, const struct dlx_universe *u) {
+    int equal =
+	l->nodes_size == u->nodes_size &&
+	l->columns_size == u->columns_size &&
+	memcmp(l->nodes, u->nodes, sizeof(struct dlx_node) * l->nodes_size) ==
+	    0 &&
+	memcmp(
+	    l->columns, u->columns,
+	    sizeof(struct dlx_column) * l->columns_size) == 0;
+
+    equal = equal && small_columns_match(u);
+
+    ++checks;
+
+    if (!equal) {
+	fprintf(
+	    stderr, "test: seed %llu: %s: links not restored\n",
+	    (unsigned long long)matrix_seed, what);
+	++failures;
+    }
+}
+
+// ## Tests
+
+/* Handler, count and pull on `u` as it is set up */
+static void test_search(
+    dlx_universe u, const struct reference *r, const char *backend,
+    uint64_t reported, uint64_t pulled) {
+    char what[64];
+    dlx_solution_iterator iter;
+
+    snprintf(what, sizeof(what), "%s search for one", backend);
+    record_begin(r);
+    dlx_universe_search(u, 1);
+    record_end(what, reported ? 1 : 0);
+
+    snprintf(what, sizeof(what), "%s search", backend);
+    record_begin(r);
+    dlx_universe_search(u, DLX_ALL);
+    record_end(what, reported);
+
+    snprintf(what, sizeof(what), "%s count", backend);
+    expect(what, dlx_universe_count(u), reported);
+
+    snprintf(what, sizeof(what), "%s pull", backend);
+    record_begin(r);
+    dlx_universe_search_begin(u, DLX_ALL);
+
+    while ((iter = dlx_universe_next_solution(u)) != NULL) {
+	record(iter);
+    }
+
+    record_end(what, pulled);
+}
+
+static size_t choose_last(
+    const size_t *columns, const size_t *sizes, size_t count, void *data) {
+    (void)columns;
+    (void)sizes;
+    (void)data;
+
+    return count - 1;
+}
+
+static void test_sink(dlx_universe u, const struct reference *r) {
+    dlx_sink sink = dlx_sink_new(-1);
+    size_t indices[MAX_ROWS] = {0}, size;
+
+    if (sink == NULL) {
+	expect_true("sink", 0);
+	return;
+    }
+
+    expect_true(
+	"sink search",
+	dlx_universe_search_sink(u, DLX_ALL, sink) == DLX_SEARCH_FINISHED);
+    expect("sink", dlx_sink_solutions(sink), r->size);
+    record_begin(r);
+
+    const uint8_t *data = dlx_sink_data(sink, &size), *end = data + size;
+
+    while (data < end) {
+	size_t n = dlx_sink_decode(&data, indices);
+	uint32_t set = 0;
+
+	for (size_t i = 0; i < n && i < MAX_ROWS; ++i) {
+	    set |= indices[i] < MAX_ROWS ? (uint32_t)1 << indices[i] : 0;
+	}
+
+	record_set(set, n > MAX_ROWS);
+    }
+
+    record_end("sink decoded", r->size);
+    dlx_sink_free(sink);
+}
+
+static void test_searches(const struct matrix *m, const struct reference *r) {
+    uint64_t pulled = m->symmetric ? r->orbits : r->size;
+    dlx_universe u = matrix_build(m, record);
+
+    if (u == NULL) {
+	expect_true("build", 0);
+	return;
+    }
+
+    test_search(u, r, "links", r->size, pulled);
+    expect_links("links search", &built, u);
+
+    struct dlx_stats stats = {0};
+
+    // Statistics are left alone when compiled out of the library
+    dlx_universe_set_stats(u, &stats);
+    dlx_universe_count(u);
+    dlx_universe_set_stats(u, NULL);
+    expect_true("stats", stats.nodes == 0 || stats.solutions == r->size);
+
+    if (!m->symmetric) {
+	test_sink(u, r);
+    } else {
+	dlx_universe_set_symmetry_report(u, DLX_SYMMETRY_CANONICAL);
+	test_search(u, r, "canonical", r->orbits, r->orbits);
+	dlx_universe_set_symmetry_report(u, DLX_SYMMETRY_ORBITS);
+    }
+
+    dlx_universe_set_backend(u, DLX_BACKEND_CELLS);
+    test_search(u, r, "cells", r->size, pulled);
+    expect_links("cells search", &built, u);
+    dlx_universe_set_backend(u, DLX_BACKEND_LINKS);
+
+    dlx_universe_set_choice(u, DLX_CHOOSE_RANDOM, matrix_seed);
+    test_search(u, r, "random choice", r->size, pulled);
+    dlx_universe_set_choice(u, DLX_CHOOSE_FIRST, 0);
+
+    expect_true(
+	"chooser", dlx_universe_set_chooser(u, &choose_last, NULL) == 0);
+    test_search(u, r, "chooser", r->size, pulled);
+    dlx_universe_set_chooser(u, NULL, NULL);
+
+    if (!m->bounded) {
+	struct dlx_estimate estimate = {0};
+
+	expect_true(
+	    "estimate",
+	    dlx_universe_estimate(u, 16, matrix_seed, &estimate) == 0);
+	expect_links("estimate", &built, u);
+    }
+
+    if (!m->bounded && !m->symmetric) {
+	uint64_t random_state = u->random_state;
+
+	record_begin(r);
+	expect_true(
+	    "restarts", dlx_universe_search_restarts(u, 2, matrix_seed) ==
+			    DLX_SEARCH_FINISHED);
+	record_end("restarts", r->size ? 1 : 0);
+	expect_true("restarts state", u->random_state == random_state);
+
+	expect_true("shuffle", dlx_universe_shuffle_rows(u, matrix_seed) == 0);
+	test_search(u, r, "shuffled", r->size, pulled);
+    }
+
+    universe_free(u);
+}
+
+/* Searches suspended every 1, 2, 4... nodes, until one does not, and aborted */
+static void test_resume(const struct matrix *m, const struct reference *r) {
+    dlx_universe u = matrix_build(m, record);
+
+    if (u == NULL) {
+	expect_true("build", 0);
+	return;
+    }
+
+    for (unsigned long nodes = 1;; nodes *= 2) {
+	int suspended = 0;
+	int agree = 1;
+
+	record_begin(r);
+	dlx_universe_search_begin(u, DLX_ALL);
+
+	while (dlx_universe_search_resume(u, nodes) == DLX_SEARCH_SUSPENDED) {
+	    suspended = 1;
+	    agree &= small_columns_match(u);
+	}
+
+	record_end("resumed search", r->size);
+	expect_true("small columns of a suspended search", agree);
+	expect_links("resumed search", &built, u);
+
+	if (!suspended) {
+	    break;
+	}
+    }
+
+    dlx_universe_search_begin(u, DLX_ALL);
+    dlx_universe_search_resume(u, 1);
+    dlx_universe_search_abort(u);
+    expect_links("abort", &built, u);
+
+    record_begin(r);
+    dlx_universe_search(u, DLX_ALL);
+    record_end("search after abort", r->size);
+
+    universe_free(u);
+}
+
+/* Searches aborted on their first node, then searches without a budget */
+static void test_budget(const struct matrix *m, const struct reference *r) {
+    dlx_universe u = matrix_build(m, record);
+
+    if (u == NULL) {
+	expect_true("build", 0);
+	return;
+    }
+
+    dlx_universe_set_budget(u, 1, 0);
+
+    int status = dlx_universe_search(u, DLX_ALL);
+
+    expect_true(
+	"budget",
+	status == DLX_SEARCH_ABORTED || status == DLX_SEARCH_FINISHED);
+    expect_true("budget status", dlx_universe_search_status(u) == status);
+    expect_links("budget", &built, u);
+
+    dlx_universe_set_budget(u, 0, 0);
+    record_begin(r);
+    expect_true(
+	"no budget", dlx_universe_search(u, DLX_ALL) == DLX_SEARCH_FINISHED);
+    record_end("no budget", r->size);
+
+    universe_free(u);
+}
+
+/* The subsets added from arrays and in compressed rows, and bad ones */
+static void test_builders(const struct matrix *m) {
+    dlx_universe array = dlx_universe_new(record, m->primary, m->secondary, 0);
+    dlx_universe csr = dlx_universe_new(record, m->primary, m->secondary, 0);
+    size_t offsets[MAX_ROWS + 1] = {0};
+    uint32_t columns[MAX_ROWS * MAX_ROW_SIZE], colors[MAX_ROWS * MAX_ROW_SIZE];
+    void *labels[MAX_ROWS];
+
+    if (array == NULL || csr == NULL) {
+	expect_true("build", 0);
+	universe_free(array);
+	universe_free(csr);
+	return;
+    }
+
+    for (size_t i = 0; i < m->size; ++i) {
+	const struct row *r = m->rows + i;
+
+	labels[i] = (void *)(uintptr_t)i;
+	offsets[i + 1] = offsets[i] + r->size;
+	memcpy(columns + offsets[i], r->columns, sizeof(uint32_t) * r->size);
+	memcpy(colors + offsets[i], r->colors, sizeof(uint32_t) * r->size);
+
+	expect_true(
+	    "subset array",
+	    dlx_universe_add_subset_array(
+		array, r->size, labels[i], r->columns,
+		m->colored ? r->colors : NULL) == 0);
+    }
+
+    expect_true(
+	"subsets", dlx_universe_add_subsets(
+		       csr, m->size, offsets, columns,
+		       m->colored ? colors : NULL, labels) == 0);
+    expect_links("subset array", &built, array);
+    expect_links("subsets", &built, csr);
+
+    // Nothing is added from a bad column
+    uint32_t column = (uint32_t)(m->primary + m->secondary);
+    uint32_t color = (uint32_t)INT32_MAX + 1;
+
+    expect_true(
+	"column out of range",
+	dlx_universe_add_subset_array(array, 1, NULL, &column, NULL) == -1);
+    expect_links("column out of range", &built, array);
+
+    column = (uint32_t)m->primary;
+    expect_true(
+	"color out of range",
+	m->secondary == 0 || dlx_universe_add_subset_array(
+				 array, 1, NULL, &column, &color) == -1);
+    expect_links("color out of range", &built, array);
+
+    expect_true(
+	"subset out of range",
+	dlx_universe_add_subset(
+	    csr, 1, NULL, (unsigned int)(m->primary + m->secondary)) == -1);
+    expect_true(
+	"colored subset out of range",
+	m->secondary == 0 ||
+	    dlx_universe_add_colored_subset(
+		csr, 1, NULL, (unsigned int)m->primary, color) == -1);
+    expect_links("subset out of range", &built, csr);
+
+    universe_free(array);
+    universe_free(csr);
+}
+
+/* The matrix written in the DLX format and read back */
+static void test_reader(const struct matrix *m, const struct reference *r) {
+    FILE *file = tmpfile();
+    dlx_reader reader = NULL;
+    dlx_universe u = NULL;
+
+    if (file == NULL) {
+	expect_true("reader", 0);
+	return;
+    }
+
+    for (size_t c = 0; c < m->primary + m->secondary; ++c) {
+	fputs(c == m->primary ? " | " : " ", file);
+
+	if (c < m->primary && (m->lo[c] != 1 || m->hi[c] != 1)) {
+	    fprintf(file, "%u:%u|", m->lo[c], m->hi[c]);
+	}
+
+	fprintf(file, "i%zu", c);
+    }
+
+    for (size_t i = 0; i < m->size; ++i) {
+	const struct row *row = m->rows + i;
+
+	for (size_t k = 0; k < row->size; ++k) {
+	    fprintf(file, k ? " i%u" : "\ni%u", row->columns[k]);
+
+	    if (row->colors[k]) {
+		fprintf(file, ":c%u", row->colors[k]);
+	    }
+	}
+    }
+
+    fputc('\n', file);
+    rewind(file);
+    reader = dlx_reader_new(file);
+
+    if (reader) {
+	u = dlx_reader_read(reader, record);
+    }
+
+    expect_true("reader", u != NULL);
+
+    if (u) {
+	record_begin(r);
+	dlx_universe_search(u, DLX_ALL);
+	record_end("reader", r->size);
+	expect_true(
+	    "reader items",
+	    dlx_reader_items(reader) == m->primary + m->secondary);
+    }
+
+    universe_free(u);
+
+    if (reader) {
+	dlx_reader_free(reader);
+    }
+
+    fclose(file);
+}
+
+static void test_parallel(const struct matrix *m, const struct reference *r) {
+    dlx_universe u = matrix_build(m, record);
+    char what[64];
+
+    if (u == NULL) {
+	expect_true("build", 0);
+	return;
+    }
+
+    for (unsigned int depth = 0; depth < 4; ++depth) {
+	snprintf(what, sizeof(what), "parallel search at depth %u", depth);
+	record_begin(r);
+	expect_true(what, dlx_universe_search_parallel(u, 0, 3, depth) == 0);
+	record_end(what, r->size);
+	expect_true(
+	    what, dlx_universe_search_status(u) == DLX_SEARCH_FINISHED);
+
+	snprintf(what, sizeof(what), "parallel count at depth %u", depth);
+	expect(what, dlx_universe_count_parallel(u, 3, depth), r->size);
+	expect_true(
+	    what, dlx_universe_search_status(u) == DLX_SEARCH_FINISHED);
+	expect_links(what, &built, u);
+    }
+
+    dlx_universe_set_backend(u, DLX_BACKEND_CELLS);
+
+    for (unsigned int depth = 0; depth < 4; ++depth) {
+	snprintf(what, sizeof(what), "cells parallel search at %u", depth);
+	record_begin(r);
+	expect_true(what, dlx_universe_search_parallel(u, 0, 3, depth) == 0);
+	record_end(what, r->size);
+
+	snprintf(what, sizeof(what), "cells parallel count at %u", depth);
+	expect(what, dlx_universe_count_parallel(u, 3, depth), r->size);
+	expect_links(what, &built, u);
+    }
+
+    universe_free(u);
+
+    // Every instance selects one subset
+    size_t offsets[MAX_ROWS + 1], subsets[MAX_ROWS];
+    uint64_t found[MAX_ROWS];
+    int statuses[MAX_ROWS];
+
+    if (m->bounded || m->symmetric) {
+	return;
+    }
+
+    u = matrix_build(m, ignore);
+
+    for (size_t i = 0; i < m->size; ++i) {
+	offsets[i] = i;
+	subsets[i] = i;
+    }
+
+    offsets[m->size] = m->size;
+
+    expect_true(
+	"batch", u != NULL && dlx_universe_search_batch(
+				  u, m->size, offsets, subsets, 0, 3, found,
+				  statuses) == 0);
+
+    for (size_t i = 0; u != NULL && i < m->size; ++i) {
+	expect("batch instance", found[i], brute_count(r, (uint32_t)1 << i));
+	expect_true("batch status", statuses[i] == DLX_SEARCH_FINISHED);
+    }
+
+    universe_free(u);
+}
+
+static void test_snapshot(const struct matrix *m, const struct reference *r) {
+    char path[] = "/tmp/dlx-test-XXXXXX";
+    int fd = mkstemp(path);
+    dlx_universe u = matrix_build(m, record), loaded = NULL;
+
+    if (fd >= 0) {
+	close(fd);
+    }
+
+    if (fd >= 0 && u != NULL && dlx_universe_save(u, path) == 0) {
+	loaded = dlx_universe_load(path, record);
+    }
+
+    expect_true("snapshot", loaded != NULL);
+
+    if (loaded) {
+	test_search(loaded, r, "snapshot", r->size, r->size);
+	universe_free(loaded);
+    }
+
+    if (fd >= 0) {
+	remove(path);
+    }
+
+    universe_free(u);
+}
+
+static void test_reduce(const struct matrix *m, const struct reference *r) {
+    static const int reductions[] = {
+	DLX_REDUCE_FORCED, DLX_REDUCE_DUPLICATES, DLX_REDUCE_DOMINATED,
+	DLX_REDUCE_BLOCKING, DLX_REDUCE_ALL};
+    dlx_universe u = matrix_build(m, record);
+
+    for (size_t i = 0; u != NULL && i < 5; ++i) {
+	char what[64];
+
+	snprintf(what, sizeof(what), "reduce %d", reductions[i]);
+	expect_true(what, dlx_universe_reduce(u, reductions[i]) == 0);
+	test_search(u, r, what, r->size, r->size);
+
+	// Removed rows keep their links to be put back
+	if (u->reduce_log_size) {
+	    expect_true(
+		what, dlx_universe_shuffle_rows(u, matrix_seed) == -1);
+	}
+
+	dlx_universe_set_backend(u, DLX_BACKEND_CELLS);
+	snprintf(what, sizeof(what), "cells reduce %d", reductions[i]);
+	test_search(u, r, what, r->size, r->size);
+	dlx_universe_set_backend(u, DLX_BACKEND_LINKS);
+
+	dlx_universe_unreduce(u);
+	snprintf(what, sizeof(what), "unreduce %d", reductions[i]);
+	expect_links(what, &built, u);
+	expect(what, dlx_universe_count(u), r->size);
+    }
+
+    universe_free(u);
+}
+
+static void test_select(const struct matrix *m, const struct reference *r) {
+    dlx_universe u = matrix_build(m, record);
+
+    for (size_t i = 0; u != NULL && i < m->size; ++i) {
+	size_t mark = dlx_universe_mark(u);
+	struct links selected;
+
+	expect_true("select", dlx_universe_select(u, i) == 0);
+	expect(
+	    "select", dlx_universe_count(u), brute_count(r, (uint32_t)1 << i));
+
+	if (links_save(&selected, u)) {
+	    expect_true("select", 0);
+	    break;
+	}
+
+	for (size_t j = i + 1; j < m->size; ++j) {
+	    size_t second = dlx_universe_mark(u);
+	    uint32_t set = (uint32_t)1 << i | (uint32_t)1 << j;
+
+	    // Subsets that can't be selected together are in no cover
+	    if (dlx_universe_select(u, j) == 0) {
+		expect(
+		    "select pair", dlx_universe_count(u), brute_count(r, set));
+		dlx_universe_set_backend(u, DLX_BACKEND_CELLS);
+		expect(
+		    "cells select pair", dlx_universe_count(u),
+		    brute_count(r, set));
+		dlx_universe_set_backend(u, DLX_BACKEND_LINKS);
+	    } else {
+		expect("conflicting pair", 0, brute_count(r, set));
+	    }
+
+	    dlx_universe_rollback(u, second);
+	    expect_links("rollback pair", &selected, u);
+	}
+
+	links_free(&selected);
+	dlx_universe_rollback(u, mark);
+	expect_links("rollback", &built, u);
+    }
+
+    universe_free(u);
+}
+
+static void test_zdd(const struct matrix *m, const struct reference *r) {
+    dlx_universe u = matrix_build(m, ignore);
+    dlx_zdd zdd = u ? dlx_universe_zdd(u) : NULL;
+    char digits[32], expected[32];
+
+    expect_true("zdd", zdd != NULL);
+
+    if (zdd) {
+	dlx_zdd_count(zdd, digits, sizeof(digits));
+	snprintf(
+	    expected, sizeof(expected), "%llu", (unsigned long long)r->size);
+	expect_true("zdd count", strcmp(digits, expected) == 0);
+	dlx_zdd_free(zdd);
+    }
+
+    universe_free(u);
+}
+
+static void test_shards(const struct matrix *m, const struct reference *r) {
+    dlx_universe u = matrix_build(m, record);
+
+    for (unsigned int depth = 0; u != NULL && depth < 4; ++depth) {
+	FILE *file = tmpfile();
+	size_t mark = dlx_universe_mark(u);
+	int selected = 0;
+
+	if (file == NULL) {
+	    expect_true("shards", 0);
+	    break;
+	}
+
+	expect_true(
+	    "write shards", dlx_universe_write_shards(u, depth, file) == 0);
+	rewind(file);
+	record_begin(r);
+
+	while ((selected = dlx_universe_select_shard(u, file)) == 1) {
+	    dlx_universe_search(u, DLX_ALL);
+	    dlx_universe_rollback(u, mark);
+	}
+
+	expect_true("select shard", selected == 0);
+	record_end("shards", r->size);
+	expect_links("shards", &built, u);
+	fclose(file);
+    }
+
+    // Indices too large to be read, one of them wrapping around to a small
+    // one, select nothing
+    static const char *const large[] = {
+	"99999999999999999999999\n", "18446744073709551619\n"};
+
+    for (size_t i = 0; u != NULL && i < sizeof(large) / sizeof(*large); ++i) {
+	FILE *file = tmpfile();
+
+	if (file == NULL) {
+	    expect_true("shards", 0);
+	    break;
+	}
+
+	fputs(large[i], file);
+	rewind(file);
+	expect_true("large shard", dlx_universe_select_shard(u, file) == -1);
+	expect_links("large shard", &built, u);
+	fclose(file);
+    }
+
+    universe_free(u);
+}
+
+static void test_restore(const struct matrix *m, const struct reference *r) {
+    char path[] = "/tmp/dlx-test-XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+	expect_true("checkpoint", 0);
+	return;
+    }
+
+    close(fd);
+
+    // Suspended after 1, 2, 4... nodes, until the search finishes first
+    for (unsigned long nodes = 1;; nodes *= 2) {
+	dlx_universe u = matrix_build(m, record), restored = NULL;
+	int status = DLX_SEARCH_FINISHED;
+
+	record_begin(r);
+
+	if (u != NULL) {
+	    dlx_universe_search_begin(u, DLX_ALL);
+	    status = dlx_universe_search_resume(u, nodes);
+	}
+
+	if (status == DLX_SEARCH_SUSPENDED) {
+	    expect_true("checkpoint", dlx_universe_checkpoint(u, path) == 0);
+	    restored = matrix_build(m, record);
+	    expect_true(
+		"restore",
+		restored != NULL && dlx_universe_restore(restored, path) == 0);
+	    expect_true(
+		"restored search", dlx_universe_search_resume(restored, 0) ==
+				       DLX_SEARCH_FINISHED);
+	}
+
+	record_end("restored search", r->size);
+	universe_free(restored);
+
+	// Counts go on from the solutions found before the checkpoint
+	if (status == DLX_SEARCH_SUSPENDED) {
+	    restored = matrix_build(m, ignore);
+	    expect_true(
+		"restore",
+		restored != NULL && dlx_universe_restore(restored, path) == 0);
+	    expect(
+		"restored count", dlx_universe_count_resume(restored), r->size);
+	    universe_free(restored);
+	}
+
+	universe_free(u);
+
+	if (status != DLX_SEARCH_SUSPENDED) {
+	    break;
+	}
+    }
+
+    remove(path);
+}
+
+static void test_matrix(const struct matrix *m, const struct reference *r) {
+    dlx_universe u = matrix_build(m, record);
+
+    if (u == NULL || links_save(&built, u)) {
+	expect_true("build", 0);
+	universe_free(u);
+	return;
+    }
+
+    universe_free(u);
+    test_searches(m, r);
+    test_resume(m, r);
+    test_parallel(m, r);
+    test_budget(m, r);
+    test_builders(m);
+    test_reader(m, r);
+
+    // Bounds and symmetries only allow the searches above
+    if (!m->bounded && !m->symmetric) {
+	test_snapshot(m, r);
+	test_reduce(m, r);
+	test_select(m, r);
+	test_zdd(m, r);
+	test_shards(m, r);
+	test_restore(m, r);
+    }
+
+    links_free(&built);
+}
+
+// ## Queens
+//
+// Every square of the board is a subset covering its row and column, and its
+// diagonals as secondary columns.
+
+#define QUEENS 10
+#define QUEENS_SOLUTIONS 724
+
+static void record_queens(dlx_solution_iterator iter) {
+    size_t size = 0;
+
+    while (dlx_solution_iterator_remaining(iter)) {
+	dlx_solution_iterator_next(iter);
+	++size;
+    }
+
+    pthread_mutex_lock(&solutions.lock);
+    ++solutions.found;
+    solutions.wrong += size != QUEENS;
+    pthread_mutex_unlock(&solutions.lock);
+}
+
+static void test_queens(void) {
+    dlx_universe u =
+	dlx_universe_new(record_queens, 2 * QUEENS, 4 * QUEENS - 2, 0);
+    struct links l;
+    char what[64];
+    int error = u == NULL;
+
+    for (unsigned int r = 0; !error && r < QUEENS; ++r) {
+	for (unsigned int c = 0; c < QUEENS; ++c) {
+	    error |= dlx_universe_add_subset(
+		u, 4, NULL, r, QUEENS + c, 2 * QUEENS + r + c,
+		5 * QUEENS - 2 + r - c);
+	}
+    }
+
+    if (error || links_save(&l, u)) {
+	expect_true("queens build", 0);
+	universe_free(u);
+	return;
+    }
+
+    for (unsigned int depth = 0; depth < 3; ++depth) {
+	snprintf(what, sizeof(what), "queens search at depth %u", depth);
+	record_begin(NULL);
+	expect_true(what, dlx_universe_search_parallel(u, 0, 4, depth) == 0);
+	record_end(what, QUEENS_SOLUTIONS);
+
+	snprintf(what, sizeof(what), "queens search for 10 at depth %u", depth);
+	record_begin(NULL);
+	expect_true(what, dlx_universe_search_parallel(u, 10, 4, depth) == 0);
+	record_end(what, 10);
+
+	snprintf(what, sizeof(what), "queens count at depth %u", depth);
+	expect(
+	    what, dlx_universe_count_parallel(u, 4, depth), QUEENS_SOLUTIONS);
+	expect_true(
+	    what, dlx_universe_search_status(u) == DLX_SEARCH_FINISHED);
+	expect_links(what, &l, u);
+    }
+
+    links_free(&l);
+    dlx_universe_free(u);
+}
+
+static void usage(void) {
+    fputs("usage: test [-n matrices] [-s seed]\n", stderr);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    unsigned long matrices = 500, seed = 1;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:s:")) != -1) {
+	switch (option) {
+	case 'n':
+	    matrices = strtoul(optarg, NULL, 10);
+	    break;
+	case 's':
+	    seed = strtoul(optarg, NULL, 10);
+	    break;
+	default:
+	    usage();
+	}
+    }
+
+    if (optind != argc) {
+	usage();
+    }
+
+    static struct matrix m;
+    static struct reference r;
+
+    test_queens();
+
+    for (unsigned long i = 0; i < matrices; ++i) {
+	matrix_seed = seed + i;
+	matrix_draw(&m, matrix_seed);
+	brute_force(&m, &r);
+	test_matrix(&m, &r);
+    }
+
+    printf(
+	"%lu matrices, %lu checks, %lu failures\n", matrices, checks, failures);
+
+    return failures ? 1 : 0;
+}
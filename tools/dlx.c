@@ -0,0 +1,423 @@
+// # dlx
+//
+// Solves an exact cover problem written in the text format of Knuth's DLX
+// programs, read from a file or from the standard input:
+//
+// 	| A comment
+// 	a b c | x y
+// 	a x:red
+// 	b c x:red y
+//
+// Every solution is printed as its options, one per line, followed by an
+// empty line, and the number of solutions is reported on the standard
+// error.
+//
+// 	usage: dlx [-c] [-i] [-C] [-r] [-s] [-z] [-e probes] [-n solutions]
+// 	           [-t threads] [-p depth | -w shards] [-k checkpoint] [file]
+// 	       dlx -M [-c] [-i] [file...]
+//
+// 	-c  only count the solutions, printing their number
+// 	-i  print the indices of the options, one solution per line
+// 	-C  search with the dancing cells backend
+// 	-r  reduce the problem first, finding solutions that only differ by
+// 	    identical options once
+// 	-s  report search statistics on the standard error
+// 	-z  count the solutions exactly, however many, through a decision
+// 	    diagram of them, reporting its number of nodes on the standard error
+// 	-e  estimate the size of the search from this many random probes
+// 	    instead, printing the nodes, solutions and updates expected with
+// 	    their standard errors
+// 	-n  stop after this many solutions
+// 	-t  search or count on this many threads, 0 for one per processor
+// 	-p  print the shards of the search this many levels down instead, one
+// 	    line of option indices each
+// 	-w  search only the shards in this file, as printed by -p with the
+// 	    same problem and options, e.g. one part of them per process
+// 	-M  merge the outputs of workers: add up the counts printed with -c,
+// 	    or print the solutions of all the files, with -i if they were
+// 	-k  checkpoint the search on one thread to this file every
+// 	    CHECKPOINT_INTERVAL nodes, going on from it if it exists and
+// 	    removing it once done; solutions printed after the last checkpoint
+// 	    of an interrupted run are printed again
+//
+// A search spread over processes thus runs as:
+//
+// 	dlx -p 3 problem > shards
+// 	split -n l/8 shards part.
+// 	for p in part.*; do dlx -c -w $p problem > $p.count & done; wait
+// 	dlx -M -c part.*.count
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlx.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHECKPOINT_INTERVAL 100000000
+
+static dlx_reader reader;
+static int print_indices = 0;
+static uint64_t solutions_found = 0;
+
+static void print_solution(dlx_solution_iterator iter) {
+    size_t option;
+
+    // Solutions may be printed from several threads
+    flockfile(stdout);
+    ++solutions_found;
+
+    while ((option = dlx_solution_iterator_next_index(iter)) != SIZE_MAX) {
+	if (print_indices) {
+	    printf(
+		dlx_solution_iterator_remaining(iter) ? "%zu " : "%zu", option);
+	    continue;
+	}
+
+	const uint32_t *items, *colors;
+	size_t size = dlx_reader_option(reader, option, &items, &colors);
+
+	for (size_t i = 0; i < size; ++i) {
+	    fputs(dlx_reader_item(reader, items[i]), stdout);
+
+	    if (colors[i]) {
+		printf(":%s", dlx_reader_color(reader, colors[i]));
+	    }
+
+	    putchar(i + 1 < size ? ' ' : '\n');
+	}
+    }
+
+    putchar('\n');
+    funlockfile(stdout);
+}
+
+static int print_zdd_count(dlx_universe universe) {
+    dlx_zdd zdd = dlx_universe_zdd(universe);
+
+    // Bounds or a lack of memory
+    if (zdd == NULL) {
+	fputs("dlx: could not build the diagram\n", stderr);
+	return 1;
+    }
+
+    size_t length = dlx_zdd_count(zdd, NULL, 0);
+    char *digits = malloc(length + 1);
+
+    if (length == 0 || digits == NULL) {
+	fputs("dlx: out of memory\n", stderr);
+	free(digits);
+	dlx_zdd_free(zdd);
+	return 1;
+    }
+
+    dlx_zdd_count(zdd, digits, length + 1);
+    printf("%s\n", digits);
+    fprintf(stderr, "%zu diagram nodes\n", dlx_zdd_size(zdd));
+
+    free(digits);
+    dlx_zdd_free(zdd);
+
+    return 0;
+}
+
+static int print_estimate(dlx_universe universe, uint64_t probes) {
+    struct dlx_estimate estimate = {0};
+
+    // Bounds
+    if (dlx_universe_estimate(universe, probes, 0, &estimate)) {
+	fputs("dlx: could not estimate the search\n", stderr);
+	return 1;
+    }
+
+    printf(
+	"%.4g nodes (+-%.2g)\n%.4g solutions (+-%.2g)\n"
+	"%.4g updates (+-%.2g)\n",
+	estimate.nodes, estimate.nodes_error, estimate.solutions,
+	estimate.solutions_error, estimate.updates, estimate.updates_error);
+
+    return 0;
+}
+
+/* Search or count the shards in `shards` one after the other */
+static int search_shards(
+    dlx_universe universe, FILE *shards, int count, unsigned int solutions,
+    uint64_t *found) {
+    size_t mark = dlx_universe_mark(universe);
+    int selected, status = 0;
+
+    while ((selected = dlx_universe_select_shard(universe, shards)) != 0) {
+	if (selected < 0) {
+	    fputs("dlx: invalid shard\n", stderr);
+	    status = 1;
+	    continue;
+	}
+
+	if (count) {
+	    *found += dlx_universe_count(universe);
+	} else if (dlx_universe_search(
+		       universe, solutions ? solutions - (unsigned int)*found
+					   : DLX_ALL)) {
+	    status = 1;
+	}
+
+	dlx_universe_rollback(universe, mark);
+
+	if (!count) {
+	    *found = solutions_found;
+
+	    if (solutions && *found >= solutions) {
+		break;
+	    }
+	}
+    }
+
+    return status;
+}
+
+/* Add up counts, or print solutions and count them, from every file */
+static int merge(char **paths, int size, int count) {
+    unsigned long long total = 0, n;
+    int status = 0;
+
+    for (int i = 0; i < size; ++i) {
+	FILE *file = fopen(paths[i], "r");
+	int c, previous = '\n';
+
+	if (file == NULL) {
+	    perror(paths[i]);
+	    status = 1;
+	    continue;
+	}
+
+	if (count) {
+	    while (fscanf(file, "%llu", &n) == 1) {
+		total += n;
+	    }
+	} else {
+	    // A solution ends with an empty line, or its line with -i
+	    while ((c = getc(file)) != EOF) {
+		putchar(c);
+		total += c == '\n' && (print_indices || previous == '\n');
+		previous = c;
+	    }
+	}
+
+	if (ferror(file) || (count && !feof(file))) {
+	    fprintf(stderr, "dlx: could not read %s\n", paths[i]);
+	    status = 1;
+	}
+
+	fclose(file);
+    }
+
+    if (count) {
+	printf("%llu\n", total);
+    } else {
+	fprintf(stderr, "%llu solutions\n", total);
+    }
+
+    return status;
+}
+
+static void usage(void) {
+    fputs(
+	"usage: dlx [-c] [-i] [-C] [-r] [-s] [-z] [-e probes] [-n solutions] "
+	"[-t threads] [-p depth | -w shards] [-k checkpoint] [file]\n"
+	"       dlx -M [-c] [-i] [file...]\n",
+	stderr);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int count = 0, cells = 0, reduce = 0, stats_wanted = 0, zdd = 0;
+    int threads = -1, depth = -1, merging = 0;
+    int option;
+    uint64_t probes = 0;
+    FILE *shards = NULL;
+    const char *checkpoint = NULL;
+    unsigned int solutions = DLX_ALL;
+    struct dlx_stats stats = {0};
+
+    while ((option = getopt(argc, argv, "ciCrsze:n:t:p:w:Mk:")) != -1) {
+	switch (option) {
+	case 'c':
+	    count = 1;
+	    break;
+	case 'i':
+	    print_indices = 1;
+	    break;
+	case 'C':
+	    cells = 1;
+	    break;
+	case 'r':
+	    reduce = 1;
+	    break;
+	case 's':
+	    stats_wanted = 1;
+	    break;
+	case 'z':
+	    zdd = 1;
+	    break;
+	case 'e':
+	    probes = strtoull(optarg, NULL, 10);
+	    break;
+	case 'n':
+	    solutions = (unsigned int)strtoul(optarg, NULL, 10);
+	    break;
+	case 't':
+	    threads = atoi(optarg);
+	    break;
+	case 'p':
+	    depth = atoi(optarg);
+	    break;
+	case 'w':
+	    shards = fopen(optarg, "r");
+
+	    if (shards == NULL) {
+		perror(optarg);
+		return 1;
+	    }
+
+	    break;
+	case 'M':
+	    merging = 1;
+	    break;
+	case 'k':
+	    checkpoint = optarg;
+	    break;
+	default:
+	    usage();
+	}
+    }
+
+    if (merging) {
+	return merge(argv + optind, argc - optind, count);
+    }
+
+    // Checkpoints are of searches and counts on one thread
+    if (argc - optind > 1 || (depth >= 0 && shards) ||
+	(checkpoint &&
+	 (zdd || probes || depth >= 0 || shards || threads >= 0))) {
+	usage();
+    }
+
+    FILE *file = optind < argc ? fopen(argv[optind], "r") : stdin;
+
+    if (file == NULL) {
+	perror(argv[optind]);
+	return 1;
+    }
+
+    reader = dlx_reader_new(file);
+
+    if (reader == NULL) {
+	fputs("dlx: out of memory\n", stderr);
+	return 1;
+    }
+
+    dlx_universe universe = dlx_reader_read(reader, print_solution);
+
+    if (file != stdin) {
+	fclose(file);
+    }
+
+    if (universe == NULL) {
+	fprintf(stderr, "dlx: %s\n", dlx_reader_error(reader));
+	dlx_reader_free(reader);
+	return 1;
+    }
+
+    if (cells) {
+	dlx_universe_set_backend(universe, DLX_BACKEND_CELLS);
+    }
+
+    if (reduce && dlx_universe_reduce(universe, DLX_REDUCE_ALL)) {
+	fputs("dlx: out of memory\n", stderr);
+	dlx_universe_free(universe);
+	dlx_reader_free(reader);
+	return 1;
+    }
+
+    if (stats_wanted) {
+	dlx_universe_set_stats(universe, &stats);
+    }
+
+    int status = 0, restored = 0;
+    uint64_t found;
+
+    if (checkpoint) {
+	dlx_universe_set_checkpoint(universe, checkpoint, CHECKPOINT_INTERVAL);
+
+	if (access(checkpoint, F_OK) == 0) {
+	    if (dlx_universe_restore(universe, checkpoint)) {
+		fprintf(stderr, "dlx: could not restore %s\n", checkpoint);
+		dlx_universe_free(universe);
+		dlx_reader_free(reader);
+		return 1;
+	    }
+
+	    restored = 1;
+	}
+    }
+
+    if (zdd) {
+	status = print_zdd_count(universe);
+	found = 0;
+    } else if (probes) {
+	status = print_estimate(universe, probes);
+	found = 0;
+    } else if (depth >= 0) {
+	status =
+	    dlx_universe_write_shards(universe, (unsigned int)depth, stdout);
+	found = 0;
+    } else if (shards) {
+	found = 0;
+	status = search_shards(universe, shards, count, solutions, &found);
+
+	if (count) {
+	    printf("%llu\n", (unsigned long long)found);
+	}
+    } else if (count && threads >= 0) {
+	found = dlx_universe_count_parallel(universe, (unsigned int)threads, 2);
+	status = dlx_universe_search_status(universe) != DLX_SEARCH_FINISHED;
+	printf("%llu\n", (unsigned long long)found);
+    } else if (count) {
+	found = restored ? dlx_universe_count_resume(universe)
+			 : dlx_universe_count(universe);
+	printf("%llu\n", (unsigned long long)found);
+    } else if (threads >= 0) {
+	status = dlx_universe_search_parallel(
+	    universe, solutions, (unsigned int)threads, 2);
+	found = solutions_found;
+    } else {
+	status = restored ? dlx_universe_search_resume(universe, 0)
+			  : dlx_universe_search(universe, solutions);
+	found = solutions_found;
+    }
+
+    if (checkpoint &&
+	dlx_universe_search_status(universe) == DLX_SEARCH_FINISHED) {
+	remove(checkpoint);
+    }
+
+    if (!count && !zdd && !probes && depth < 0) {
+	fprintf(stderr, "%llu solutions\n", (unsigned long long)found);
+    }
+
+    if (stats_wanted) {
+	fprintf(
+	    stderr, "%llu nodes, %llu updates, depth %zu\n",
+	    (unsigned long long)stats.nodes, (unsigned long long)stats.updates,
+	    stats.max_depth);
+    }
+
+    if (shards) {
+	fclose(shards);
+    }
+
+    dlx_universe_free(universe);
+    dlx_reader_free(reader);
+
+    return status ? 1 : 0;
+}